@@ -0,0 +1,127 @@
+/*
+ * AdcScanner.cpp - Free-running, interrupt driven scan of several ADC channels
+ * Part of ONI - Objeto Não Identificado
+ */
+
+#include "Arduino.h"
+#include <util/atomic.h>
+#include "AdcScanner.h"
+#include "Handoff.h"
+#include "IrqAudit.h"
+
+static uint8_t channels[ADC_SCANNER_SLOTS]; //ADC channel of each slot
+static volatile uint8_t slots; //slots in use
+static volatile uint8_t current; //slot being summed
+static volatile uint8_t discard; //conversions still running on the previous channel
+static volatile uint8_t samples; //samples summed so far
+static volatile uint16_t sum; //block being summed
+static SpscRing<uint16_t, 1> blocks[ADC_SCANNER_SLOTS]; //complete block of each slot, pushed by the interrupt and popped by take()
+static volatile boolean parked; //every slot had a block waiting, the interrupt is masked
+
+//Points the ADC at a slot. The conversion already running keeps the old channel, so its result is discarded
+static void select(uint8_t slot)
+{
+    uint8_t channel = channels[slot];
+    current = slot;
+    ADMUX = (1 << REFS0) | (channel & 0x07); //AVcc reference
+#if defined(MUX5)
+    ADCSRB = (channel & 0x08) ? (1 << MUX5) : 0; //ADTS = 0, free running
+#else
+    ADCSRB = 0;
+#endif
+    discard = 1;
+    samples = 0;
+    sum = 0;
+}
+
+//Restarts the scan on a slot from outside the interrupt. A conversion that ended while nobody listened left
+//ADIF pending, which would use up select()'s discard and let the old channel's conversion in flight into the
+//block: clear it first
+static void resume(uint8_t slot)
+{
+    parked = false;
+    select(slot);
+    ADCSRA |= (1 << ADIF) | (1 << ADIE); //ADIF clears by writing 1
+}
+
+ISR(ADC_vect)
+{
+    IRQ_AUDIT_ISR(IRQ_ISR_ADC, 0); //free running, the conversion end isn't timed
+    if (discard)
+    {
+        discard--;
+        return;
+    }
+    sum += ADC;
+    if (++samples != (1 << ADC_SCANNER_SHIFT))
+    {
+        return;
+    }
+    blocks[current].push((uint16_t)sum); //never full, a slot with a block waiting isn't scanned
+    for (uint8_t i = 1; i <= slots; i++) //next slot without a block waiting, this one last
+    {
+        uint8_t next = (current + i) % slots;
+        if (!blocks[next].full())
+        {
+            select(next);
+            return;
+        }
+    }
+    parked = true;
+    ADCSRA &= ~(1 << ADIE); //the ADC keeps running, nobody listens until a block is taken
+}
+
+//Adds a channel (0~15) to the scan and starts the ADC if needed. Returns the slot, or -1 when full
+int8_t AdcScanner::add(uint8_t channel)
+{
+    int8_t slot = -1;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (slots < ADC_SCANNER_SLOTS)
+        {
+            slot = slots;
+            channels[slot] = channel;
+            slots++;
+            if (slot == 0 || parked)
+            {
+                parked = false;
+                select(slot);
+                //enable, start, auto trigger, interrupt, clear a pending flag, 16 MHz / 128 = 125 kHz ADC clock (about 9600 samples per second)
+                ADCSRA = (1 << ADEN) | (1 << ADSC) | (1 << ADATE) | (1 << ADIE) | (1 << ADIF) | (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0);
+            }
+        }
+    }
+    return slot;
+}
+
+//Takes the waiting block of a slot: the sum of 2^ADC_SCANNER_SHIFT samples. Returns false when there's none yet
+//Interrupts only go off to wake a parked scan. An interrupt landing after the pop sees the slot free
+//and doesn't park, so parked can't be missed here
+boolean AdcScanner::take(uint8_t slot, uint16_t &blockSum)
+{
+    if (!blocks[slot].pop(blockSum))
+    {
+        return false;
+    }
+    if (parked)
+    {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            resume(slot); //on the slot just freed
+        }
+    }
+    return true;
+}
+
+//Throws away what a slot has sampled so far, so the next block taken is sampled entirely from now on
+void AdcScanner::drop(uint8_t slot)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        blocks[slot].flush();
+        if (parked || current == slot) //restart the slot's block right away
+        {
+            resume(slot);
+        }
+    }
+}
@@ -0,0 +1,32 @@
+/*
+ * AdcScanner.h - Free-running, interrupt driven scan of several ADC channels
+ * Part of ONI - Objeto Não Identificado
+ *
+ * The ADC runs in free-running mode. The conversion interrupt sums a
+ * block of samples of one channel, hands it over and moves on to the next
+ * channel whose last block was already taken. When every channel has a
+ * block waiting the interrupt masks itself until one is taken, so nothing
+ * ever waits on a conversion and the interrupt load follows how often
+ * blocks are consumed.
+ *
+ * Once a channel is added the ADC belongs to the scanner: analogRead()
+ * must not be used.
+ */
+
+#ifndef ADCSCANNER_H
+#define ADCSCANNER_H
+
+#include "Arduino.h"
+
+#define ADC_SCANNER_SLOTS 4
+#define ADC_SCANNER_SHIFT 6 //samples per block, as a power of two. 64 samples of 10 bits fit in 16 bits
+
+class AdcScanner
+{
+  public:
+    static int8_t add(uint8_t);
+    static boolean take(uint8_t, uint16_t &);
+    static void drop(uint8_t);
+};
+
+#endif
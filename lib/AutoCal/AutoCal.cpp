@@ -0,0 +1,165 @@
+/*
+ * AutoCal.cpp - Automatic stall PWM search for one motor and direction
+ * Part of ONI - Objeto Não Identificado
+ */
+
+#include "AutoCal.h"
+
+#define SAMPLE_TIMEOUT 100 //ms without a reading before giving up, the sense input is missing
+
+AutoCal::AutoCal()
+{
+    setTiming(150, 4, 300);
+    setThreshold(1000);
+    setResolution(2);
+    _state = AUTOCAL_IDLE;
+    low = 0;
+    high = 255;
+    trial = 0;
+    moved = false;
+    _probes = 0;
+    reading = 0;
+    since = 0;
+}
+
+//settleMs: drive time per probe, blankingMs: coast before sampling, restMs: coast after a probe that moved
+void AutoCal::setTiming(uint16_t _settleMs, uint16_t _blankingMs, uint16_t _restMs)
+{
+    settleMs = _settleMs;
+    blankingMs = _blankingMs;
+    restMs = _restMs;
+}
+
+//Readings above threshold mean the motor was spinning
+void AutoCal::setThreshold(uint16_t _threshold)
+{
+    threshold = _threshold;
+}
+
+//The search stops once the stall and move duties are this close
+void AutoCal::setResolution(uint8_t _resolution)
+{
+    resolution = _resolution ? _resolution : 1;
+}
+
+//Searches between low (expected to stall) and high (expected to move). The first probe checks high does move
+void AutoCal::start(uint32_t now, uint8_t _low, uint8_t _high)
+{
+    low = _low;
+    high = _high;
+    _probes = 0;
+    trial = high;
+    probe(now);
+}
+
+void AutoCal::abort()
+{
+    _state = AUTOCAL_IDLE;
+}
+
+void AutoCal::probe(uint32_t now)
+{
+    _probes++;
+    _state = AUTOCAL_DRIVE;
+    since = now;
+}
+
+//Advances the search to now, in ms. Returns the state
+uint8_t AutoCal::step(uint32_t now)
+{
+    uint32_t elapsed = now - since;
+    switch (_state)
+    {
+        case AUTOCAL_DRIVE:
+            if (elapsed >= settleMs)
+            {
+                _state = AUTOCAL_BLANK;
+                since = now;
+            }
+            break;
+        case AUTOCAL_BLANK:
+            if (elapsed >= blankingMs)
+            {
+                _state = AUTOCAL_SAMPLE;
+                since = now;
+            }
+            break;
+        case AUTOCAL_SAMPLE:
+            if (elapsed >= SAMPLE_TIMEOUT)
+            {
+                _state = AUTOCAL_FAILED;
+            }
+            break;
+        case AUTOCAL_REST:
+            if (elapsed < (moved ? restMs : 0))
+            {
+                break;
+            }
+            if (trial == high && !moved) //even the top of the range stalls: jammed wheel or no sense input
+            {
+                _state = AUTOCAL_FAILED;
+                break;
+            }
+            if (high - low <= resolution)
+            {
+                _state = AUTOCAL_DONE;
+                break;
+            }
+            trial = low + (high - low) / 2;
+            probe(now);
+            break;
+    }
+    return _state;
+}
+
+//Hands over the coast reading the search waits for in AUTOCAL_SAMPLE
+void AutoCal::sense(uint16_t _reading)
+{
+    if (_state != AUTOCAL_SAMPLE)
+    {
+        return;
+    }
+    reading = _reading;
+    moved = reading > threshold;
+    if (moved)
+    {
+        high = trial;
+    }
+    else if (trial != high)
+    {
+        low = trial;
+    }
+    _state = AUTOCAL_REST;
+}
+
+uint8_t AutoCal::state()
+{
+    return _state;
+}
+
+bool AutoCal::busy()
+{
+    return _state >= AUTOCAL_DRIVE && _state <= AUTOCAL_REST;
+}
+
+//Duty to drive now, 0 means coast
+uint8_t AutoCal::duty()
+{
+    return _state == AUTOCAL_DRIVE ? trial : 0;
+}
+
+//Lowest duty seen moving the motor. Valid in AUTOCAL_DONE
+uint8_t AutoCal::result()
+{
+    return high;
+}
+
+uint8_t AutoCal::probes()
+{
+    return _probes;
+}
+
+uint16_t AutoCal::lastReading()
+{
+    return reading;
+}
@@ -0,0 +1,65 @@
+/*
+ * AutoCal.h - Automatic stall PWM search for one motor and direction
+ * Part of ONI - Objeto Não Identificado
+ *
+ * Binary searches the lowest PWM that breaks a motor away from rest. Each
+ * probe drives the motor at a trial duty, lets it settle, cuts the drive
+ * and, after a short blanking time for the inductive kick to die out,
+ * takes one back-EMF reading while the motor coasts: a spinning motor
+ * reads above the threshold, a stalled one doesn't. A motor that moved is
+ * given time to stop before the next probe.
+ *
+ * The search knows nothing about pins or the ADC: step() advances it on
+ * the caller's clock, duty() is what to drive, and while the state is
+ * AUTOCAL_SAMPLE it waits for sense() with a reading taken during the
+ * coast. That keeps it usable off the robot.
+ */
+
+#ifndef AUTOCAL_H
+#define AUTOCAL_H
+
+#include <stdint.h>
+
+#define AUTOCAL_IDLE 0
+#define AUTOCAL_DRIVE 1 //driving the trial duty
+#define AUTOCAL_BLANK 2 //coasting, waiting for the inductive kick to die out
+#define AUTOCAL_SAMPLE 3 //coasting, waiting for sense()
+#define AUTOCAL_REST 4 //coasting, waiting for the motor to stop
+#define AUTOCAL_DONE 5
+#define AUTOCAL_FAILED 6
+
+class AutoCal
+{
+  public:
+    AutoCal();
+    void setTiming(uint16_t, uint16_t, uint16_t);
+    void setThreshold(uint16_t);
+    void setResolution(uint8_t);
+    void start(uint32_t, uint8_t, uint8_t);
+    void abort();
+    uint8_t step(uint32_t);
+    void sense(uint16_t);
+    uint8_t state();
+    bool busy();
+    uint8_t duty();
+    uint8_t result();
+    uint8_t probes();
+    uint16_t lastReading();
+  private:
+    void probe(uint32_t);
+    uint16_t settleMs;
+    uint16_t blankingMs;
+    uint16_t restMs;
+    uint16_t threshold;
+    uint8_t resolution;
+    uint8_t _state;
+    uint8_t low; //highest duty known to stall
+    uint8_t high; //lowest duty known to move
+    uint8_t trial;
+    bool moved;
+    uint8_t _probes;
+    uint16_t reading;
+    uint32_t since; //start of the current state
+};
+
+#endif
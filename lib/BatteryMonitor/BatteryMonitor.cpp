@@ -0,0 +1,103 @@
+/*
+ * BatteryMonitor.cpp - Battery voltage monitor on a free-running ADC
+ * Part of ONI - Objeto Não Identificado
+ */
+
+#include "Arduino.h"
+#include "AdcScanner.h"
+#include "BatteryMonitor.h"
+
+#define FILTER_SHIFT 2 //exponential filter weight, each update() moves 1/4 of the way
+
+//channel: ADC channel (0~15), fullScaleMv: battery voltage that reads as ADC full scale, through the divider
+BatteryMonitor::BatteryMonitor(uint8_t _channel, uint16_t _fullScaleMv)
+{
+    channel = _channel;
+    fullScaleMv = _fullScaleMv;
+    filtered = 0;
+    seeded = false;
+    slot = -1;
+    setCharge(0, 0xFFFF);
+    setLimit(0, 0, 255);
+}
+
+//Adds the channel to the ADC scan. Must be called from setup(), init() configures the ADC after global constructors
+void BatteryMonitor::begin()
+{
+    slot = AdcScanner::add(channel);
+}
+
+//Folds the last complete block into the filter. Cheap, call periodically from the main loop
+void BatteryMonitor::update()
+{
+    uint16_t block;
+    if (slot < 0 || !AdcScanner::take(slot, block))
+    {
+        return;
+    }
+
+    if (!seeded)
+    {
+        filtered = block; //first block seeds the filter, so limiting doesn't start from 0 V
+        seeded = true;
+    }
+    else
+    {
+        filtered += ((int32_t)block - filtered) >> FILTER_SHIFT;
+    }
+}
+
+//State of charge is linear between emptyMv (0%) and fullMv (100%)
+void BatteryMonitor::setCharge(uint16_t _emptyMv, uint16_t _fullMv)
+{
+    emptyMv = _emptyMv;
+    fullMv = _fullMv;
+}
+
+//Output ceiling is 255 at and above sagMv and falls linearly to minLimit at cutoffMv
+void BatteryMonitor::setLimit(uint16_t _sagMv, uint16_t _cutoffMv, uint8_t _minLimit)
+{
+    sagMv = _sagMv;
+    cutoffMv = _cutoffMv;
+    minLimit = _minLimit;
+}
+
+//Filtered battery voltage, in mV. filtered holds 64 summed 10 bit samples, a 16 bit fraction of full scale
+uint16_t BatteryMonitor::millivolts()
+{
+    return ((uint32_t)filtered * fullScaleMv) >> 16;
+}
+
+//State of charge, 0~100%
+uint8_t BatteryMonitor::charge()
+{
+    uint16_t mv = millivolts();
+    if (mv <= emptyMv)
+    {
+        return 0;
+    }
+    if (mv >= fullMv)
+    {
+        return 100;
+    }
+    return (uint32_t)(mv - emptyMv) * 100 / (fullMv - emptyMv);
+}
+
+//Motor output ceiling, 0~255. Keeps the motors from sagging the logic rail into a brown-out
+uint8_t BatteryMonitor::outputLimit()
+{
+    if (!seeded)
+    {
+        return minLimit; //no reading yet, stay conservative
+    }
+    uint16_t mv = millivolts();
+    if (mv >= sagMv)
+    {
+        return 255;
+    }
+    if (mv <= cutoffMv)
+    {
+        return minLimit;
+    }
+    return minLimit + (uint32_t)(mv - cutoffMv) * (255 - minLimit) / (sagMv - cutoffMv);
+}
@@ -0,0 +1,38 @@
+/*
+ * BatteryMonitor.h - Battery voltage monitor on a free-running ADC
+ * Part of ONI - Objeto Não Identificado
+ *
+ * Samples come in blocks from AdcScanner, so the battery never costs a
+ * blocking analogRead(). Filtering is done in fixed point.
+ */
+
+#ifndef BATTERYMONITOR_H
+#define BATTERYMONITOR_H
+
+#include "Arduino.h"
+
+class BatteryMonitor
+{
+  public:
+    BatteryMonitor(uint8_t, uint16_t);
+    void begin();
+    void update();
+    void setCharge(uint16_t, uint16_t);
+    void setLimit(uint16_t, uint16_t, uint8_t);
+    uint16_t millivolts();
+    uint8_t charge();
+    uint8_t outputLimit();
+  private:
+    uint8_t channel;
+    int8_t slot;
+    uint16_t fullScaleMv;
+    uint16_t filtered;
+    boolean seeded;
+    uint16_t emptyMv;
+    uint16_t fullMv;
+    uint16_t sagMv;
+    uint16_t cutoffMv;
+    uint8_t minLimit;
+};
+
+#endif
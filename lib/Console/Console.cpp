@@ -0,0 +1,174 @@
+/*
+ * Console.cpp - Non-blocking, allocation-free serial command console
+ * Part of ONI - Objeto Não Identificado
+ */
+
+#include "Arduino.h"
+#include "Console.h"
+
+//stream: where commands come from and replies go, commands: command table, count: how many commands
+Console::Console(Stream &_stream, const ConsoleCommand *_commands, uint8_t _count)
+{
+    stream = &_stream;
+    commands = _commands;
+    count = _count;
+    length = 0;
+    overflow = false;
+    pending = NULL;
+    replyLine = 0;
+    outLength = 0;
+    outSent = 0;
+    lineCount = 0;
+    errorCount = 0;
+}
+
+//Takes up to maxBytes from the stream. Runs the command when a line ends. While a reply is
+//going on, writes what the stream takes of it instead
+void Console::poll(uint8_t maxBytes)
+{
+    if (pending != NULL)
+    {
+        send();
+        return;
+    }
+    while (maxBytes-- > 0 and stream->available() > 0)
+    {
+        char c = stream->read();
+        if (c == '\r' or c == '\n')
+        {
+            if (overflow)
+            {
+                stream->println(F("line too long"));
+                errorCount++;
+            }
+            else if (length > 0)
+            {
+                line[length] = '\0';
+                execute();
+            }
+            length = 0;
+            overflow = false;
+            return; //at most one command per poll
+        }
+        if (length < CONSOLE_LINE_LENGTH)
+        {
+            line[length++] = c;
+        }
+        else
+        {
+            overflow = true;
+        }
+    }
+}
+
+//Writes the rest of the reply through writer, see poll(). Replaces any reply still going on
+void Console::reply(ConsoleReply writer)
+{
+    pending = writer;
+    replyLine = 0;
+    outLength = 0;
+    outSent = 0;
+}
+
+//A reply is still being written. Whoever else writes to the stream should wait, or the lines mix
+bool Console::replying()
+{
+    return pending != NULL;
+}
+
+//Puts line n of the command list, "name - help", in line. A ConsoleReply for the sketch's help
+bool Console::helpLine(uint8_t n, char *line)
+{
+    if (n >= count)
+    {
+        return false;
+    }
+    strlcpy_P(line, commands[n].name, CONSOLE_REPLY_LENGTH + 1);
+    strlcat_P(line, PSTR(" - "), CONSOLE_REPLY_LENGTH + 1);
+    strlcat_P(line, commands[n].help, CONSOLE_REPLY_LENGTH + 1);
+    return true;
+}
+
+//Writes as much of the reply line as the stream takes without waiting, taking the next line once it's all out
+void Console::send()
+{
+    if (outSent == outLength)
+    {
+        if (not pending(replyLine++, out))
+        {
+            pending = NULL;
+            return;
+        }
+        outLength = strlen(out);
+        out[outLength++] = '\r';
+        out[outLength++] = '\n';
+        outSent = 0;
+    }
+    int room = stream->availableForWrite();
+    if (room > outLength - outSent)
+    {
+        room = outLength - outSent;
+    }
+    if (room > 0)
+    {
+        stream->write((const uint8_t *)out + outSent, room);
+        outSent += room;
+    }
+}
+
+//Lines run since boot
+uint16_t Console::lines()
+{
+    return lineCount;
+}
+
+//Lines that were too long or named no command
+uint16_t Console::errors()
+{
+    return errorCount;
+}
+
+//Splits the line on spaces in place and runs the matching command
+void Console::execute()
+{
+    char *argv[CONSOLE_MAX_ARGS];
+    uint8_t argc = 0;
+    char *p = line;
+    while (argc < CONSOLE_MAX_ARGS) //words past CONSOLE_MAX_ARGS are ignored
+    {
+        while (*p == ' ')
+        {
+            p++;
+        }
+        if (*p == '\0')
+        {
+            break;
+        }
+        argv[argc++] = p;
+        while (*p != ' ' and *p != '\0')
+        {
+            p++;
+        }
+        if (*p == ' ')
+        {
+            *p++ = '\0';
+        }
+    }
+    if (argc == 0)
+    {
+        return;
+    }
+
+    lineCount++;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (strcmp_P(argv[0], commands[i].name) == 0)
+        {
+            commands[i].run(argc, argv);
+            return;
+        }
+    }
+    errorCount++;
+    stream->print(F("unknown command: "));
+    stream->println(argv[0]);
+}
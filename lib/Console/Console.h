@@ -0,0 +1,63 @@
+/*
+ * Console.h - Non-blocking, allocation-free serial command console
+ * Part of ONI - Objeto Não Identificado
+ *
+ * poll() takes at most a given number of bytes from the stream per call
+ * and assembles them into a fixed line buffer. When a line is complete it
+ * is split on spaces in place and the matching command from the sketch's
+ * table runs. Nothing is allocated and a call never waits for input.
+ *
+ * A command that answers with several lines hands a line writer to
+ * reply() instead of printing. From then on poll() formats one line at a
+ * time into its own buffer and writes only as many bytes as the stream
+ * takes without waiting (availableForWrite()), taking no input until the
+ * reply is over. So a call never waits for output either, however long
+ * the reply.
+ */
+
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include "Arduino.h"
+
+#define CONSOLE_LINE_LENGTH 40
+#define CONSOLE_MAX_ARGS 8 //including the command name
+#define CONSOLE_REPLY_LENGTH 96 //longest reply line, without the line end
+
+typedef bool (*ConsoleReply)(uint8_t, char *); //puts line n of a reply in the buffer, without the line end. Returns false once past the last line
+
+typedef struct {
+    const char *name; //in PROGMEM
+    void (*run)(uint8_t, char **); //argc, argv. argv[0] is the command name
+    const char *help; //in PROGMEM, one line
+} ConsoleCommand;
+
+class Console
+{
+  public:
+    Console(Stream &, const ConsoleCommand *, uint8_t);
+    void poll(uint8_t);
+    void reply(ConsoleReply);
+    bool replying();
+    bool helpLine(uint8_t, char *);
+    uint16_t lines();
+    uint16_t errors();
+  private:
+    void execute();
+    void send();
+    Stream *stream;
+    const ConsoleCommand *commands;
+    uint8_t count;
+    char line[CONSOLE_LINE_LENGTH + 1];
+    uint8_t length;
+    boolean overflow; //the current line didn't fit, it's dropped at its end
+    ConsoleReply pending; //reply being written, NULL for none
+    uint8_t replyLine; //next line of it
+    char out[CONSOLE_REPLY_LENGTH + 3]; //line being written, with its line end
+    uint8_t outLength;
+    uint8_t outSent;
+    uint16_t lineCount;
+    uint16_t errorCount;
+};
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ * DriveMixer.cpp - Stick to engine speed mixing
+ * Part of ONI - Objeto Não Identificado
+ */
+
+#include <math.h>
+#include "DriveMixer.h"
+
+//Same as Arduino's map(), which isn't there on the host, but an empty input range maps to outMin
+//instead of dividing by zero. turnRate 0 makes the turn term's ranges empty
+static long scale(long x, long inMin, long inMax, long outMin, long outMax)
+{
+    if (inMax == inMin)
+    {
+        return outMin;
+    }
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+//Converts an analog axis (0~255) to a speed (-255~255). The middle position, give or take
+//DRIVE_MIXER_DEADZONE, is 0: the engine curves would lift any other speed to the stall PWM
+int DriveMixer::stick(uint8_t value, bool invert)
+{
+    if (value >= 128 - DRIVE_MIXER_DEADZONE && value <= 128 + DRIVE_MIXER_DEADZONE) //if analogs are around the middle position
+    {
+        return 0; //no movement
+    }
+    if (invert)
+    {
+        return int(-value*2 + 128*2 - 1); //maps value to range from 0~255 to 255~(-255), inverted
+    }
+    return int(+value*2 - 128*2 + 1); //maps value to range from 0~255 to -255~255
+}
+
+//Mixes accel (-255~255) and curve (-255~255) into engine speeds. turnRate controls how sharp turning is (0~1). Returns curvatureSpeed (0~1)
+float DriveMixer::mix(int accel, int curve, float turnRate, int &speedL, int &speedR)
+{
+    //Set speed according to accel readings. Set curvatureSpeed to 0 in case of no curves
+    speedL = accel;
+    speedR = accel;
+
+    float curvatureSpeed = 0;
+    int curvatureToSpeed = 0; //could use a byte?
+    int curvatureToSpeedReversed = 0; //could use a byte?
+    float pAccel = float(accel)/255; //divide by maximum possible value to get a percentage number
+    float pCurve = float(curve)/255; //1 = 100%, 0.5 = 50%
+    //might be able to optimize speed by not using this percentage in the engine math
+
+    //Calculate curvatureSpeed only if there is accel and curve
+    if (curve != 0 && accel != 0)
+    {
+        curvatureSpeed = float(scale(int(((1 - pow(fabsf(pAccel),fabsf(pCurve))) + float(scale(turnRate*fabsf(pCurve)*100 - turnRate*fabsf(pAccel)*50,-turnRate*50,turnRate*100,0,turnRate*100))/100)*100),0,100 + turnRate*100,0,100))/100; //really complicated stuff. There's a picture attached to the source code explaining this.
+        curvatureToSpeed = scale(curvatureSpeed*100,0,100,accel,-accel); //when curvatureSpeed is 0, no curves. When 50, one wheel stops. When 100, this wheel spins at the same speed that the accel, but reverse.
+        //probably should not convert into percentages then out
+        curvatureToSpeedReversed = -scale(curvatureSpeed*100,0,100,-accel,accel); //when curvatureSpeed is 0, no curves. When -50, one wheel stops. When -100, this wheel spins at the same speed that the accel, but reverse.
+    }
+    //Setting speeds
+    //For accel > 0 and accel < 0 speedR and speedL get set to the same values, just reversed. It might be possible to remove these statements by incorporating these cases to the main formula
+    if (accel > 0) //going forward
+    {
+        //For turning
+        if (curve > 0) //going right
+        {
+            speedR = curvatureToSpeed;
+        }
+        else if (curve < 0) //going left
+        {
+            speedL = curvatureToSpeed;
+        }
+    }
+    else if (accel < 0) //going reverse
+    {
+        //For turning
+        if (curve > 0) //going right
+        {
+            speedR = curvatureToSpeedReversed;
+        }
+        else if (curve < 0) //going left
+        {
+            speedL = curvatureToSpeedReversed;
+        }
+    }
+    return curvatureSpeed;
+}
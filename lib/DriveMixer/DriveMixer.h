@@ -0,0 +1,23 @@
+/*
+ * DriveMixer.h - Stick to engine speed mixing
+ * Part of ONI - Objeto Não Identificado
+ *
+ * The math engineManager() drives with, kept free of pins and globals so
+ * the host simulator (tools/sim) runs exactly the same code.
+ */
+
+#ifndef DRIVEMIXER_H
+#define DRIVEMIXER_H
+
+#include <stdint.h>
+
+#define DRIVE_MIXER_DEADZONE 4 //stick counts either side of the middle that read as no movement. A resting stick sits a few counts off 128
+
+class DriveMixer
+{
+  public:
+    static int stick(uint8_t, bool);
+    static float mix(int, int, float, int &, int &);
+};
+
+#endif
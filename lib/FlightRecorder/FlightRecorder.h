@@ -0,0 +1,82 @@
+/*
+ * FlightRecorder.h - Fixed-size ring of the last control cycles
+ * Part of ONI - Objeto Não Identificado
+ *
+ * Keeps the last Depth records of whatever Record type the sketch packs
+ * each cycle. Recording is O(1): add() hands out the slot of the oldest
+ * record and nothing is formatted. freeze() stops recording so the
+ * history can be dumped after the fact, at whatever pace the output
+ * allows, without the cycles that follow overwriting it.
+ */
+
+#ifndef FLIGHTRECORDER_H
+#define FLIGHTRECORDER_H
+
+#include "Arduino.h"
+
+template <typename Record, uint8_t Depth>
+class FlightRecorder
+{
+    static_assert(Depth > 0 && (Depth & (Depth - 1)) == 0, "Depth must be a power of two");
+
+  public:
+    FlightRecorder() : head(0), stored(0), isFrozen(false) {}
+
+    //Slot for the next record, to be filled in place. While frozen a scratch slot is handed out
+    Record &add()
+    {
+        if (isFrozen)
+        {
+            return scratch;
+        }
+        Record &slot = records[head];
+        head = (head + 1) & (Depth - 1);
+        if (stored < Depth)
+        {
+            stored++;
+        }
+        return slot;
+    }
+
+    //How many records are held, up to Depth
+    uint8_t count()
+    {
+        return stored;
+    }
+
+    //Record by age: 0 is the oldest held, count() - 1 the newest
+    const Record &at(uint8_t index)
+    {
+        return records[(head - stored + index) & (Depth - 1)];
+    }
+
+    void freeze()
+    {
+        isFrozen = true;
+    }
+
+    void unfreeze()
+    {
+        isFrozen = false;
+    }
+
+    boolean frozen()
+    {
+        return isFrozen;
+    }
+
+    void clear()
+    {
+        head = 0;
+        stored = 0;
+    }
+
+  private:
+    Record records[Depth];
+    Record scratch;
+    uint8_t head; //where the next record goes
+    uint8_t stored;
+    boolean isFrozen;
+};
+
+#endif
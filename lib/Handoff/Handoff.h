@@ -0,0 +1,186 @@
+/*
+ * Handoff.h - Lock-free handoff between interrupts and the main loop
+ * Part of ONI - Objeto Não Identificado
+ *
+ * Three header-only templates for data crossing the interrupt boundary,
+ * none of which turns interrupts off:
+ *
+ * SpscRing<T, N>  queue with one producer and one consumer, either side
+ *                 may be the interrupt. N is a power of two up to 128.
+ * Seqlock<T>      latest value written by an interrupt, read by the loop.
+ *                 The reader copies again when a write landed meanwhile.
+ * DoubleBuffer<T> latest value written by the loop, read by an interrupt.
+ *                 The writer fills the hidden copy and flips an index.
+ *
+ * On the AVR a single byte load or store is atomic and the CPU never
+ * reorders memory accesses, so one-byte indexes and counters written by
+ * a single side are enough, as long as the compiler keeps the accesses in
+ * order: that's what HANDOFF_BARRIER() is for. Everything else, including
+ * T, may be any size. Nothing here uses Arduino, so it builds on the host.
+ */
+
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <stdint.h>
+
+//Keeps the compiler from moving memory accesses across it. Costs no instructions. tools/sim/handoff.cpp
+//defines its own, to run the other side at every one of them
+#ifndef HANDOFF_BARRIER
+#define HANDOFF_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+#endif
+
+template <typename T, uint8_t N>
+class SpscRing
+{
+    static_assert(N > 0 && N <= 128 && (N & (N - 1)) == 0, "SpscRing size must be a power of two up to 128");
+
+  public:
+    SpscRing() : head(0), tail(0), overflows(0) {}
+
+    //Producer side. Returns false, and counts an overflow, when the ring is full
+    bool push(const T &item)
+    {
+        uint8_t h = head;
+        if (uint8_t(h - tail) == N)
+        {
+            overflows = overflows + 1;
+            return false;
+        }
+        HANDOFF_BARRIER(); //the slot is free only once tail says so
+        items[h & (N - 1)] = item;
+        HANDOFF_BARRIER(); //the item is in place before it's published
+        head = h + 1;
+        return true;
+    }
+
+    //Consumer side. Returns false when the ring is empty
+    bool pop(T &item)
+    {
+        uint8_t t = tail;
+        if (t == head)
+        {
+            return false;
+        }
+        HANDOFF_BARRIER(); //the item is read only once head says it's there
+        item = items[t & (N - 1)];
+        HANDOFF_BARRIER(); //the item is out before its slot is given back
+        tail = t + 1;
+        return true;
+    }
+
+    //Consumer side. Like pop(), but the item stays in the ring
+    bool peek(T &item) const
+    {
+        uint8_t t = tail;
+        if (t == head)
+        {
+            return false;
+        }
+        HANDOFF_BARRIER();
+        item = items[t & (N - 1)];
+        return true;
+    }
+
+    //Consumer side. Drops everything waiting
+    void flush()
+    {
+        tail = head;
+    }
+
+    //Either side. Seen from the other side, it may already be out of date by the time it returns
+    uint8_t count() const { return uint8_t(head - tail); }
+    bool empty() const { return head == tail; }
+    bool full() const { return uint8_t(head - tail) == N; }
+    uint8_t dropped() const { return overflows; } //pushes refused for lack of room, wraps at 256
+
+  private:
+    T items[N];
+    volatile uint8_t head; //next slot to fill, written by the producer only. Indexes run free and wrap at 256
+    volatile uint8_t tail; //next slot to empty, written by the consumer only
+    volatile uint8_t overflows; //written by the producer only
+};
+
+//Writer in an interrupt, reader in the loop. The other way around the reader would spin forever
+//inside the interrupt, waiting for a writer that can't run: use DoubleBuffer
+template <typename T>
+class Seqlock
+{
+  public:
+    Seqlock() : sequence(0), writes(0), value() {}
+
+    //Writer side
+    void write(const T &in)
+    {
+        sequence = sequence + 1; //odd: a write is going on
+        HANDOFF_BARRIER();
+        value = in;
+        HANDOFF_BARRIER();
+        sequence = sequence + 1;
+        writes = writes + 1;
+    }
+
+    //Reader side. Returns false when a write landed during the copy and out may be torn
+    bool tryRead(T &out) const
+    {
+        uint8_t before = sequence;
+        HANDOFF_BARRIER();
+        out = value;
+        HANDOFF_BARRIER();
+        return !(before & 1) && before == sequence;
+    }
+
+    //Reader side. Copies until a copy went through untouched. Each retry means the writer
+    //ran in the middle, so this only loops as long as the interrupt keeps firing that fast
+    void read(T &out) const
+    {
+        while (!tryRead(out))
+        {
+            ;
+        }
+    }
+
+    //Writes so far, wraps at 256. A reader can tell whether something new came in
+    uint8_t version() const { return writes; }
+
+  private:
+    volatile uint8_t sequence; //twice the writes, plus one while writing, so it wraps every 128. 128 writes during a single copy would go unnoticed
+    volatile uint8_t writes; //counted apart from sequence so version() wraps at 256, not 128
+    T value;
+};
+
+//Writer in the loop, reader in an interrupt. The interrupt always reads the published copy whole,
+//because the loop can't run until it returns. The other way around a copy could be rewritten while
+//the loop reads it: use Seqlock
+template <typename T>
+class DoubleBuffer
+{
+  public:
+    DoubleBuffer() : published(0) {}
+
+    //Writer side. The hidden copy, to fill before publish()
+    T &back() { return copies[published ^ 1]; }
+
+    //Writer side. Makes the hidden copy the one read
+    void publish()
+    {
+        HANDOFF_BARRIER(); //the copy is complete before the flip
+        published = published ^ 1;
+    }
+
+    //Writer side
+    void write(const T &in)
+    {
+        back() = in;
+        publish();
+    }
+
+    //Reader side
+    const T &read() const { return copies[published]; }
+
+  private:
+    T copies[2];
+    volatile uint8_t published; //index of the copy being read, written by the writer only
+};
+
+#endif
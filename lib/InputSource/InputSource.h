@@ -0,0 +1,49 @@
+/*
+ * InputSource.h - Where the sticks and buttons come from
+ * Part of ONI - Objeto Não Identificado
+ *
+ * The mode logic reads its sticks and buttons through an InputSource, so
+ * it doesn't care whether they came over the PS2 bus (PS2XInput) or from
+ * a host over a UART (SerialDrive). Every source speaks the PS2 pad's
+ * layout: four sticks 0~255 centred on 128, and a 16-bit button word with
+ * the PSB_* masks of PS2X_lib.h, 1 = pressed.
+ *
+ * read() runs once per control cycle. What it took stays until the next
+ * read(), and so do the edges seen by buttonPressed() and buttonReleased().
+ */
+
+#ifndef INPUTSOURCE_H
+#define INPUTSOURCE_H
+
+#include <stdint.h>
+
+//Status of what the last read() took
+#define INPUT_OK 0 //fresh and well formed
+#define INPUT_LOST 1 //nothing answering, or the last good command is too old
+#define INPUT_BAD 2 //something answers, but its frames don't check out
+#define INPUT_BROWNOUT 3 //well formed, but carrying the source's low voltage pattern
+#define INPUT_STATUSES 4
+
+//Sticks, see analog()
+#define INPUT_LX 0
+#define INPUT_LY 1
+#define INPUT_RX 2
+#define INPUT_RY 3
+
+class InputSource
+{
+  public:
+    virtual bool read() = 0; //takes the newest input, true when it's a new one
+    virtual uint8_t status() = 0; //INPUT_*
+    virtual uint8_t analog(uint8_t) = 0; //INPUT_LX, INPUT_LY, INPUT_RX or INPUT_RY
+    virtual uint16_t buttons() = 0; //PSB_* bits, 1 = pressed
+    virtual uint16_t lastButtons() = 0; //buttons() before the last read()
+    virtual uint16_t invalidStreak() = 0; //reads in a row that weren't INPUT_OK
+
+    bool button(uint16_t mask) { return (buttons() & mask) != 0; }
+    bool newButtonState() { return buttons() != lastButtons(); }
+    bool buttonPressed(uint16_t mask) { return (buttons() & ~lastButtons() & mask) != 0; }
+    bool buttonReleased(uint16_t mask) { return (~buttons() & lastButtons() & mask) != 0; }
+};
+
+#endif
@@ -0,0 +1,188 @@
+/*
+ * IrqAudit.cpp - Interrupt latency auditor on a Timer4 probe
+ * Part of ONI - Objeto Não Identificado
+ */
+
+#ifdef IRQ_AUDIT
+
+#include "Arduino.h"
+#include <util/atomic.h>
+#include "IrqAudit.h"
+
+static const char SITE_NAMES[IRQ_AUDIT_SITES][12] PROGMEM = {"other", "wait", "ps2x.read", "ps2x.shift", "ps2x.config", "l293d", "control", "output", "telemetry", "console", "buzzer"};
+static const char ISR_NAMES[IRQ_AUDIT_ISRS][9] PROGMEM = {"timebase", "adc", "uart"};
+
+volatile uint8_t IrqAudit::current = IRQ_SITE_OTHER;
+//Only written by interrupts, read and cleared with interrupts off
+static IrqAuditSiteStats sites[IRQ_AUDIT_SITES];
+static IrqAuditIsrStats isrs[IRQ_AUDIT_ISRS];
+static uint32_t probeCount;
+static uint16_t lateCount; //probes that waited half a period or more
+static uint16_t floorWait; //least probe wait, the entry cost with nothing in the way
+static uint16_t worstWait;
+static uint8_t worstAt; //site of worstWait
+static uint8_t lastIsr; //instrumented interrupt that ran since the last probe, IRQ_AUDIT_NO_ISR for none
+static uint16_t lastIsrEnd; //TCNT4 at its last line
+
+ISR(TIMER4_COMPA_vect)
+{
+    uint16_t now = TCNT4;
+    uint16_t compare = OCR4A;
+    uint16_t wait = now - compare;
+    if (wait < IRQ_AUDIT_PERIOD / 2)
+    {
+        OCR4A = compare + IRQ_AUDIT_PERIOD;
+    }
+    else //the next match could already be behind the counter, ask for it a period from now
+    {
+        OCR4A = now + IRQ_AUDIT_PERIOD;
+        lateCount++;
+    }
+
+    probeCount++;
+    if (wait < floorWait)
+    {
+        floorWait = wait;
+    }
+    uint8_t at = IrqAudit::current;
+    sites[at].probes++;
+    if (wait > sites[at].worst)
+    {
+        sites[at].worst = wait;
+    }
+    if (wait > worstWait)
+    {
+        worstWait = wait;
+        worstAt = at;
+    }
+    //An instrumented interrupt that ended after the match and right before this held the probe
+    if (lastIsr != IRQ_AUDIT_NO_ISR)
+    {
+        if ((uint16_t)(lastIsrEnd - compare) <= wait && (uint16_t)(now - lastIsrEnd) < IRQ_AUDIT_CHAIN && wait > isrs[lastIsr].worstBlock)
+        {
+            isrs[lastIsr].worstBlock = wait;
+        }
+        lastIsr = IRQ_AUDIT_NO_ISR;
+    }
+}
+
+//Takes Timer4 over: free running at the CPU clock, the probe on OCR4A
+void IrqAudit::begin()
+{
+    uint8_t sreg = SREG;
+    cli();
+    TCCR4A = 0;
+    TCCR4B = 0;
+    TCNT4 = 0;
+    OCR4A = IRQ_AUDIT_PERIOD;
+    TIFR4 = (1 << OCF4A); //written 1 clears it
+    TIMSK4 = (1 << OCIE4A);
+    TCCR4B = (1 << CS40); //normal mode, no prescaler
+    SREG = sreg;
+    reset();
+}
+
+void IrqAudit::reset()
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        memset(sites, 0, sizeof(sites));
+        memset(isrs, 0, sizeof(isrs));
+        probeCount = 0;
+        lateCount = 0;
+        floorWait = 0xFFFF;
+        worstWait = 0;
+        worstAt = IRQ_SITE_OTHER;
+        lastIsr = IRQ_AUDIT_NO_ISR;
+    }
+}
+
+//Called by IRQ_AUDIT_ISR() at the end of an interrupt
+void IrqAudit::isrDone(uint8_t isr, uint16_t start, uint16_t entry)
+{
+    uint16_t end = TCNT4;
+    IrqAuditIsrStats &stats = isrs[isr];
+    stats.runs++;
+    if ((uint16_t)(end - start) > stats.worstDuration)
+    {
+        stats.worstDuration = end - start;
+    }
+    if (entry > stats.worstEntry)
+    {
+        stats.worstEntry = entry;
+    }
+    lastIsr = isr;
+    lastIsrEnd = end;
+}
+
+IrqAuditSiteStats IrqAudit::site(uint8_t site)
+{
+    IrqAuditSiteStats copy;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        copy = sites[site];
+    }
+    return copy;
+}
+
+IrqAuditIsrStats IrqAudit::isr(uint8_t isr)
+{
+    IrqAuditIsrStats copy;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        copy = isrs[isr];
+    }
+    return copy;
+}
+
+uint32_t IrqAudit::probes()
+{
+    uint32_t count;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        count = probeCount;
+    }
+    return count;
+}
+
+//Probes that waited half a period or more
+uint16_t IrqAudit::late()
+{
+    uint16_t count;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        count = lateCount;
+    }
+    return count;
+}
+
+//Least probe wait in cycles: the entry cost. A wait above it is a window with interrupts off
+uint16_t IrqAudit::floor()
+{
+    uint16_t wait;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        wait = floorWait;
+    }
+    return probes() == 0 ? 0 : wait;
+}
+
+//Site of the longest probe wait
+uint8_t IrqAudit::worstSite()
+{
+    return worstAt; //a byte, read in one go
+}
+
+//Site name in PROGMEM
+const char *IrqAudit::siteName(uint8_t site)
+{
+    return SITE_NAMES[site];
+}
+
+//Interrupt name in PROGMEM
+const char *IrqAudit::isrName(uint8_t isr)
+{
+    return ISR_NAMES[isr];
+}
+
+#endif
@@ -0,0 +1,126 @@
+/*
+ * IrqAudit.h - Interrupt latency auditor on a Timer4 probe
+ * Part of ONI - Objeto Não Identificado
+ *
+ * Only built with -D IRQ_AUDIT (pio run -e audit). Without it every macro
+ * below is empty and Timer4 is left to the core.
+ *
+ * Timer4 runs free at the CPU clock, so TCNT4 is a 16-bit cycle counter.
+ * A compare interrupt, the probe, is asked for every IRQ_AUDIT_PERIOD
+ * cycles and the first thing it does is read how many cycles ago its
+ * compare match was. That wait is the fixed entry cost (the floor, the
+ * least wait seen) plus however long interrupts were off when the match
+ * came: a cli() section or another interrupt running. The worst wait is
+ * kept for the code site that was interrupted, marked by the drivers and
+ * the sketch with IRQ_AUDIT_SITE(), and for an instrumented interrupt
+ * that ran inside the wait. The share of probes landing in each site is
+ * also where the CPU time goes.
+ *
+ * Interrupts wrapped in IRQ_AUDIT_ISR() also keep their run count, their
+ * worst duration and, for timers, their worst entry latency. The core's
+ * own interrupts (Timer0 millis, serial, tone) can't be wrapped: their
+ * time shows up as waits charged to the site they interrupted.
+ *
+ * The probe takes around a tenth of the CPU at the default period and
+ * delays other interrupts by up to its own duration. Timer4 is no longer
+ * available for PWM on pins 6, 7 and 8.
+ */
+
+#ifndef IRQ_AUDIT_H
+#define IRQ_AUDIT_H
+
+//Code sites, see IRQ_AUDIT_SITE()
+#define IRQ_SITE_OTHER 0 //nothing marked: setup(), the scheduler between tasks
+#define IRQ_SITE_WAIT 1 //Scheduler::waitFrame(), sleeping or spinning to the next frame
+#define IRQ_SITE_PS2X_READ 2 //PS2X::read_gamepad() outside the byte shifts
+#define IRQ_SITE_PS2X_SHIFT 3 //PS2X::_gamepad_shiftinout(), cli() around every pin write
+#define IRQ_SITE_PS2X_CONFIG 4 //PS2X::config_gamepad() and reconfig_gamepad()
+#define IRQ_SITE_L293D 5 //L293D::set(), coast() and brake(), digitalWrite() and analogWrite()
+#define IRQ_SITE_CONTROL 6 //oni.cpp mode logic, key sequences and recorder
+#define IRQ_SITE_OUTPUT 7 //oni.cpp outputManager() outside the engines
+#define IRQ_SITE_TELEMETRY 8 //oni.cpp debugManager(), formatting and serial writes
+#define IRQ_SITE_CONSOLE 9 //oni.cpp console and recorder dump
+#define IRQ_SITE_BUZZER 10 //oni.cpp buzzerManager(), tone()
+#define IRQ_AUDIT_SITES 11
+
+//Instrumented interrupts, see IRQ_AUDIT_ISR()
+#define IRQ_ISR_TIMEBASE 0 //TIMER5_COMPA, Timebase milliseconds
+#define IRQ_ISR_ADC 1 //ADC, AdcScanner
+#define IRQ_ISR_SERIAL_DRIVE 2 //USART1_RX, SerialDrive
+#define IRQ_AUDIT_ISRS 3
+#define IRQ_AUDIT_NO_ISR 0xFF
+
+#ifdef IRQ_AUDIT
+
+#include "Arduino.h"
+
+#ifndef IRQ_AUDIT_PERIOD
+#define IRQ_AUDIT_PERIOD 1600 //cycles between probes, 100 us at 16 MHz
+#endif
+#define IRQ_AUDIT_CHAIN 64 //most cycles from an interrupt's last line to the probe's first when one follows the other
+
+//Marks the rest of the enclosing scope as site, restoring the outer site when it ends
+#define IRQ_AUDIT_SITE(site) IrqAuditSite irqAuditSite_(site)
+//First line of an ISR body. entry is the cycles from the trigger to here, 0 when the trigger time isn't known
+#define IRQ_AUDIT_ISR(isr, entry) IrqAuditIsr irqAuditIsr_(isr, entry)
+
+typedef struct
+{
+    uint32_t probes; //probes that landed here
+    uint16_t worst; //longest probe wait, in cycles
+} IrqAuditSiteStats;
+
+typedef struct
+{
+    uint32_t runs;
+    uint16_t worstDuration; //cycles from the first line of the body to the last
+    uint16_t worstEntry; //cycles from the trigger to the first line of the body
+    uint16_t worstBlock; //longest probe wait it ran in
+} IrqAuditIsrStats;
+
+class IrqAudit
+{
+  public:
+    static void begin();
+    static void reset();
+    static IrqAuditSiteStats site(uint8_t);
+    static IrqAuditIsrStats isr(uint8_t);
+    static uint32_t probes();
+    static uint16_t late();
+    static uint16_t floor();
+    static uint8_t worstSite();
+    static const char *siteName(uint8_t);
+    static const char *isrName(uint8_t);
+
+    static volatile uint8_t current; //site running now
+    static void isrDone(uint8_t, uint16_t, uint16_t);
+};
+
+class IrqAuditSite
+{
+  public:
+    IrqAuditSite(uint8_t site) : outer(IrqAudit::current) { IrqAudit::current = site; }
+    ~IrqAuditSite() { IrqAudit::current = outer; }
+  private:
+    uint8_t outer;
+};
+
+class IrqAuditIsr
+{
+  public:
+    IrqAuditIsr(uint8_t _isr, uint16_t _entry) : start(TCNT4), isr(_isr), entry(_entry) {}
+    ~IrqAuditIsr() { IrqAudit::isrDone(isr, start, entry); }
+  private:
+    uint16_t start; //first, so it's read before anything else
+    uint8_t isr;
+    uint16_t entry;
+};
+
+#else
+
+#define IRQ_AUDIT_SITE(site)
+#define IRQ_AUDIT_ISR(isr, entry)
+
+#endif
+
+#endif
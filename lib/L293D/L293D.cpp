@@ -7,6 +7,8 @@
 
 #include "Arduino.h"
 #include "L293D.h"
+#include "Timebase.h"
+#include "IrqAudit.h"
 
 L293D::L293D(int _pin_E, int _pin_A, int _pin_B)
 {
@@ -16,44 +18,132 @@ L293D::L293D(int _pin_E, int _pin_A, int _pin_B)
     pin_E = _pin_E;
     pin_A = _pin_A;
     pin_B = _pin_B;
+    _state = L293D_COAST;
+    brakeDuty = 0;
+    dir = 0;
+    driven = 0;
+    since = 0;
+    deadTime = 0;
+    deadBrake = 0;
     // Set initially to 0
     set(0);
 }
 
+// Changes the inputs, only ever with the enable low
+void L293D::setInputs(int8_t _dir)
+{
+    if(dir == _dir)
+    {
+        return;
+    }
+    digitalWrite(pin_E, LOW);
+    digitalWrite(pin_A, _dir > 0 ? HIGH : LOW);
+    digitalWrite(pin_B, _dir < 0 ? HIGH : LOW);
+    dir = _dir;
+}
+
+// Drives at value (-255~255), 0 coasts. A reversal first brakes through
+// the dead time without blocking: the new direction is applied by the
+// first set() after it, so keep calling set() periodically
 void L293D::set(int value)
 {
+    IRQ_AUDIT_SITE(IRQ_SITE_L293D);
     if(value == 0)
     {
-        digitalWrite(pin_E, LOW);
-        val = value;
+        coast();
+        return;
     }
-    else if(value > 0 && value <= 255)
+    value = constrain(value, -255, 255);
+    int8_t _dir = value > 0 ? 1 : -1;
+    // the motor may still be spinning the other way if it was driven that way recently
+    boolean spinning = _state == L293D_DRIVE || Timebase::elapsedMs(since) < deadTime;
+    if(deadTime > 0 && driven == -_dir && spinning && _state != L293D_REVERSING)
     {
-        // disable before possibly switching directions
-        digitalWrite(pin_E, LOW);
-        // drive pin A HIGH and pin B LOW
-        digitalWrite(pin_A, HIGH);
-        digitalWrite(pin_B, LOW);
-        // enable
-        analogWrite(pin_E, value);
-        // Save value its been set to
+        setInputs(0);
+        analogWrite(pin_E, deadBrake);
+        brakeDuty = deadBrake;
+        _state = L293D_REVERSING;
+        since = Timebase::ms();
         val = value;
+        return;
     }
-    else if(value < 0 && value >= -255)
+    if(_state == L293D_REVERSING && Timebase::elapsedMs(since) < deadTime)
     {
-        // disable before possibly switching directions
-        digitalWrite(pin_E, LOW);
-        // drive pin A LOW and pin B HIGH
-        digitalWrite(pin_A, LOW);
-        digitalWrite(pin_B, HIGH);
-        // enable
-        analogWrite(pin_E, value*-1);
-        // Save value its been set to
-        val = value;
+        val = value; // still in the dead time
+        return;
+    }
+    setInputs(_dir);
+    analogWrite(pin_E, abs(value));
+    driven = _dir;
+    if(_state != L293D_DRIVE)
+    {
+        _state = L293D_DRIVE;
+        since = Timebase::ms();
     }
+    // Save value its been set to
+    val = value;
 }
 
 int L293D::get()
 {
     return val;
-}
\ No newline at end of file
+}
+
+// Duty driven right now (-255~255). Unlike get(), 0 while braking or
+// in the dead time of a reversal, as the motor isn't driven then
+int L293D::output()
+{
+    return _state == L293D_DRIVE ? val : 0;
+}
+
+// Brake duty applied right now, 0 when not braking or reversing
+uint8_t L293D::braking()
+{
+    return _state == L293D_BRAKE || _state == L293D_REVERSING ? brakeDuty : 0;
+}
+
+// Lets the motor spin freely
+void L293D::coast()
+{
+    IRQ_AUDIT_SITE(IRQ_SITE_L293D);
+    digitalWrite(pin_E, LOW);
+    if(_state != L293D_COAST)
+    {
+        _state = L293D_COAST;
+        since = Timebase::ms();
+    }
+    val = 0;
+}
+
+// Shorts the motor through both low side drivers for duty/255 of the time and lets it coast for the rest. 255 stops hardest
+void L293D::brake(uint8_t duty)
+{
+    IRQ_AUDIT_SITE(IRQ_SITE_L293D);
+    if(duty == 0)
+    {
+        coast();
+        return;
+    }
+    setInputs(0);
+    analogWrite(pin_E, duty);
+    brakeDuty = duty;
+    if(_state != L293D_BRAKE)
+    {
+        _state = L293D_BRAKE;
+        since = Timebase::ms();
+    }
+    val = 0;
+}
+
+// Every reversal brakes at brakeDuty for ms before driving the other way. 0 ms reverses at once
+void L293D::setDeadTime(uint16_t ms, uint8_t brakeDuty)
+{
+    deadTime = ms;
+    deadBrake = brakeDuty;
+}
+
+// L293D_COAST, L293D_DRIVE, L293D_BRAKE or L293D_REVERSING
+uint8_t L293D::state()
+{
+    return _state;
+}
@@ -9,17 +9,37 @@
 
 #include "Arduino.h"
 
+// Output states, see state()
+#define L293D_COAST 0 // enable low, the motor spins freely
+#define L293D_DRIVE 1
+#define L293D_BRAKE 2 // both inputs low, the enable duty shorts the motor
+#define L293D_REVERSING 3 // braking through the dead time of a reversal
+
 class L293D
 {
   public:
   	L293D(int, int, int);
   	void set(int);
   	int get();
+  	int output();
+  	uint8_t braking();
+  	void coast();
+  	void brake(uint8_t);
+  	void setDeadTime(uint16_t, uint8_t);
+  	uint8_t state();
   private:
+  	void setInputs(int8_t);
   	int pin_E;
   	int pin_A;
   	int pin_B;
   	int val;
+  	uint8_t _state;
+  	uint8_t brakeDuty; // enable duty while braking or reversing
+  	int8_t dir; // inputs in place: 1 forward, -1 reverse, 0 both low
+  	int8_t driven; // last direction driven
+  	unsigned long since; // Timebase::ms() of the last state change
+  	uint16_t deadTime; // ms between directions
+  	uint8_t deadBrake; // brake duty during the dead time
 };
 
 #endif
@@ -0,0 +1,138 @@
+/*
+ * L293DThermal.cpp - Thermal model and duty derating for one L293D chip
+ * Part of ONI - Objeto Não Identificado
+ */
+
+#include "Arduino.h"
+#include "L293DThermal.h"
+
+L293DThermal::L293DThermal()
+{
+    setChip(2600, 600, 36, 30);
+    setDerating(25, 110, 140, 96);
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        sense[i] = L293D_THERMAL_NO_SENSE;
+        last[i] = 0;
+        brake[i] = 0;
+        surge[i] = 0;
+        estimate[i] = 0;
+    }
+    power = 0;
+    rise = 0;
+    remainder = 0;
+    lastUpdate = 0;
+    started = false;
+}
+
+//dropMv: output drop at the working current, fullDutyMa: current at full duty, rth: C/W junction to ambient, tauS: thermal time constant
+void L293DThermal::setChip(uint16_t _dropMv, uint16_t _fullDutyMa, uint8_t _rth, uint16_t _tauS)
+{
+    dropMv = _dropMv;
+    fullDutyMa = _fullDutyMa;
+    rth = _rth;
+    tauS = _tauS ? _tauS : 1;
+}
+
+//Duty ceiling is 255 up to startC and falls linearly to minDuty at limitC, all die temperatures in C
+void L293DThermal::setDerating(uint8_t _ambient, uint8_t _startC, uint8_t _limitC, uint8_t _minDuty)
+{
+    ambient = _ambient;
+    startC = _startC;
+    limitC = _limitC > _startC ? _limitC : _startC + 1;
+    minDuty = _minDuty;
+}
+
+//Measured current of a channel (0 or 1) in mA, for the next update(). L293D_THERMAL_NO_SENSE goes back to estimating
+void L293DThermal::setCurrent(uint8_t channel, uint16_t mA)
+{
+    sense[channel] = mA;
+}
+
+//Brake duty of a channel (0 or 1) for the next update(), 0 when it isn't braking
+void L293DThermal::setBrake(uint8_t channel, uint8_t duty)
+{
+    brake[channel] = duty;
+}
+
+//Current of a channel driven at duty (-255~255), in mA
+uint16_t L293DThermal::channelCurrent(uint8_t channel, int duty)
+{
+    if ((duty > 0 && last[channel] < 0) || (duty < 0 && last[channel] > 0)) //reversing: back-EMF adds to the supply until the engine stops
+    {
+        surge[channel] = abs(last[channel]);
+    }
+    else if (brake[channel] && last[channel] != 0) //braking a driven engine: its back-EMF drives the current through the short, for duty/255 of the time
+    {
+        surge[channel] = (uint32_t)abs(last[channel]) * brake[channel] / 255;
+    }
+    else
+    {
+        surge[channel] >>= 1; //gone in a few tens of ms
+    }
+    last[channel] = duty;
+    if (sense[channel] != L293D_THERMAL_NO_SENSE)
+    {
+        return sense[channel];
+    }
+    return (uint32_t)(abs(duty) + surge[channel]) * fullDutyMa / 255;
+}
+
+//Feeds the duty of both channels and the time, in ms. Call every output cycle
+void L293DThermal::update(int dutyA, int dutyB, unsigned long now)
+{
+    estimate[0] = channelCurrent(0, dutyA);
+    estimate[1] = channelCurrent(1, dutyB);
+    power = ((uint32_t)estimate[0] + estimate[1]) * dropMv / 1000;
+    if (!started)
+    {
+        started = true;
+        lastUpdate = now;
+        return;
+    }
+    uint32_t elapsed = now - lastUpdate;
+    lastUpdate = now;
+    if (elapsed > tauS * 125UL) //a long gap counts as tau / 8, keeps the product below in 32 bits
+    {
+        elapsed = tauS * 125UL;
+    }
+    int32_t target = (int32_t)power * rth * 256 / 1000; //steady rise for this dissipation, in 1/256 C
+    int32_t k = elapsed * 65536 / (tauS * 1000UL); //fraction of the way covered, in 1/65536
+    int32_t step = (target - rise) * k + remainder; //in 1/256 C << 16
+    rise += step >> 16;
+    remainder = step & 0xFFFF; //kept for the next update: dropping it would stop the rise short once each step is below 1/256 C
+}
+
+//Estimated die temperature, in C
+uint8_t L293DThermal::temperature()
+{
+    int32_t c = ambient + (rise >> 8);
+    return c > 255 ? 255 : c;
+}
+
+//Estimated dissipation of the last update, in mW
+uint16_t L293DThermal::dissipation()
+{
+    return power;
+}
+
+//Current of a channel in the last update, measured or estimated, in mA
+uint16_t L293DThermal::current(uint8_t channel)
+{
+    return estimate[channel];
+}
+
+//Duty ceiling for both channels, 0~255
+uint8_t L293DThermal::maxDuty()
+{
+    uint8_t c = temperature();
+    if (c <= startC)
+    {
+        return 255;
+    }
+    if (c >= limitC)
+    {
+        return minDuty;
+    }
+    return 255 - (uint16_t)(c - startC) * (255 - minDuty) / (limitC - startC);
+}
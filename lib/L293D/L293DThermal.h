@@ -0,0 +1,59 @@
+/*
+ * L293DThermal.h - Thermal model and duty derating for one L293D chip
+ * Part of ONI - Objeto Não Identificado
+ *
+ * Both channels of the chip heat the same die. Each channel dissipates
+ * about its output drop times its current, the current coming from a
+ * current sense when there's one and otherwise estimated from the duty,
+ * plus a surge when a channel reverses into its own back-EMF or brakes
+ * it through the low side drivers. A motor that has stopped draws nothing
+ * through the brake, however long it is held. The die
+ * temperature follows the dissipation through a single RC stage, in fixed
+ * point, and the duty ceiling falls linearly from 255 at the derating
+ * start to a floor at the limit, well before the chip's own thermal
+ * shutdown cuts the engines.
+ */
+
+#ifndef L293DTHERMAL_H
+#define L293DTHERMAL_H
+
+#include "Arduino.h"
+
+#define L293D_THERMAL_NO_SENSE 0xFFFF
+
+class L293DThermal
+{
+  public:
+    L293DThermal();
+    void setChip(uint16_t, uint16_t, uint8_t, uint16_t);
+    void setDerating(uint8_t, uint8_t, uint8_t, uint8_t);
+    void setCurrent(uint8_t, uint16_t);
+    void setBrake(uint8_t, uint8_t);
+    void update(int, int, unsigned long);
+    uint8_t temperature();
+    uint16_t dissipation();
+    uint16_t current(uint8_t);
+    uint8_t maxDuty();
+  private:
+    uint16_t channelCurrent(uint8_t, int);
+    uint16_t dropMv; //output drop, high plus low side, at the currents used
+    uint16_t fullDutyMa; //estimated current at full duty, without current sense
+    uint8_t rth; //junction to ambient, in C/W
+    uint16_t tauS; //thermal time constant, in s
+    uint8_t ambient; //C
+    uint8_t startC; //derating starts at this die temperature
+    uint8_t limitC; //and reaches minDuty at this one
+    uint8_t minDuty;
+    uint16_t sense[2]; //measured mA, or L293D_THERMAL_NO_SENSE
+    int last[2]; //duty of the previous update
+    uint8_t brake[2]; //brake duty of the next update, 0 when not braking
+    uint16_t surge[2]; //extra duty equivalent current after a reversal or brake, decays every update
+    uint16_t estimate[2]; //mA of the last update
+    uint16_t power; //mW of the last update
+    int32_t rise; //die temperature over ambient, in 1/256 C
+    uint16_t remainder; //of rise below 1/256 C, in 1/65536 of that
+    unsigned long lastUpdate;
+    boolean started;
+};
+
+#endif
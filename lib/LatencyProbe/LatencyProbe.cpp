@@ -0,0 +1,171 @@
+/*
+ * LatencyProbe.cpp - Input to actuation latency of the control path
+ * Part of ONI - Objeto Não Identificado
+ */
+
+#ifdef ARDUINO
+#include "Arduino.h"
+#endif
+#include <stdio.h>
+#include "LatencyProbe.h"
+
+static const char *const NAMES[LATENCY_EVENTS] = {"poll", "rx", "mix", "output"};
+
+//Bucket of a latency in us: 0 under 64 us, then 4 per octave
+static uint8_t bucket(uint32_t us)
+{
+    if (us < 64)
+    {
+        return 0;
+    }
+    uint8_t octave = 6;
+    while (octave < 31 && (us >> (octave + 1)) != 0)
+    {
+        octave++;
+    }
+    uint8_t index = 1 + (octave - 6) * 4 + ((us >> (octave - 2)) & 3);
+    return index < LATENCY_BUCKETS ? index : LATENCY_BUCKETS - 1;
+}
+
+//Largest latency a bucket holds, in us
+static uint32_t bucketTop(uint8_t index)
+{
+    if (index == 0)
+    {
+        return 63;
+    }
+    uint8_t octave = 6 + (index - 1) / 4;
+    return ((uint32_t)(4 + (index - 1) % 4 + 1) << (octave - 2)) - 1;
+}
+
+LatencyProbe::LatencyProbe()
+{
+#ifdef ARDUINO
+    for (uint8_t i = 0; i < LATENCY_EVENTS; i++)
+    {
+        pinReg[i] = 0;
+        pinMask[i] = 0;
+    }
+#endif
+    reset();
+}
+
+//Toggles pin on every mark of event. LATENCY_NO_PIN takes the marker away. No pins on the host
+void LatencyProbe::setPin(uint8_t event, uint8_t pin)
+{
+#ifdef ARDUINO
+    if (pin == LATENCY_NO_PIN)
+    {
+        pinReg[event] = 0;
+        return;
+    }
+    pinMode(pin, OUTPUT);
+    pinMask[event] = digitalPinToBitMask(pin);
+    pinReg[event] = portInputRegister(digitalPinToPort(pin));
+#else
+    (void)event;
+    (void)pin;
+#endif
+}
+
+//Marks an event at now, in us
+void LatencyProbe::mark(uint8_t event, uint32_t now)
+{
+#ifdef ARDUINO
+    if (pinReg[event])
+    {
+        *pinReg[event] = pinMask[event];
+    }
+#endif
+    if (event == LATENCY_POLL_START)
+    {
+        start = now;
+        seen = 1;
+        return;
+    }
+    if (!(seen & 1) || (seen & (1 << event))) //no cycle open, or this event was already counted
+    {
+        return;
+    }
+    seen |= 1 << event;
+    uint32_t latency = now - start;
+    uint16_t *counts = histogram[event - 1];
+    uint8_t index = bucket(latency);
+    if (counts[index] == 0xFFFF) //halve everything, percentiles don't change
+    {
+        for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+        {
+            counts[i] >>= 1;
+        }
+    }
+    counts[index]++;
+    if (latency > _worst[event - 1])
+    {
+        _worst[event - 1] = latency;
+    }
+    if (event == LATENCY_OUTPUT_COMMIT)
+    {
+        _cycles++;
+        seen = 0; //the cycle reached the engines
+    }
+}
+
+//Latency from poll start under which pct% of the marks of event fell, in us, rounded up to its bucket but never above the worst
+uint32_t LatencyProbe::percentile(uint8_t event, uint8_t pct)
+{
+    uint16_t *counts = histogram[event - 1];
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        total += counts[i];
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+    uint32_t wanted = (total * pct + 99) / 100;
+    uint32_t sum = 0;
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        sum += counts[i];
+        if (sum >= wanted && counts[i] != 0)
+        {
+            uint32_t top = bucketTop(i);
+            return i == LATENCY_BUCKETS - 1 || top > _worst[event - 1] ? _worst[event - 1] : top;
+        }
+    }
+    return _worst[event - 1];
+}
+
+//Longest latency from poll start of event, in us
+uint32_t LatencyProbe::worst(uint8_t event)
+{
+    return _worst[event - 1];
+}
+
+//Cycles that reached an output commit
+uint16_t LatencyProbe::cycles()
+{
+    return _cycles;
+}
+
+//Writes "latency <event> p50 p90 p99 max" into line, in us from poll start. Needs 48 bytes
+void LatencyProbe::format(uint8_t event, char *line)
+{
+    sprintf(line, "latency %s %lu %lu %lu %lu", NAMES[event], (unsigned long)percentile(event, 50), (unsigned long)percentile(event, 90), (unsigned long)percentile(event, 99), (unsigned long)worst(event));
+}
+
+void LatencyProbe::reset()
+{
+    for (uint8_t e = 0; e < LATENCY_EVENTS - 1; e++)
+    {
+        for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+        {
+            histogram[e][i] = 0;
+        }
+        _worst[e] = 0;
+    }
+    _cycles = 0;
+    start = 0;
+    seen = 0;
+}
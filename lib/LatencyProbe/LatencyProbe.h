@@ -0,0 +1,52 @@
+/*
+ * LatencyProbe.h - Input to actuation latency of the control path
+ * Part of ONI - Objeto Não Identificado
+ *
+ * The control path marks four events every control cycle: poll start,
+ * frame received, mix done and output committed. Each mark toggles the
+ * event's marker pin, if it has one, for a logic analyzer, and the time
+ * from poll start to the event goes into a histogram with four buckets
+ * per octave, good for percentiles within about 20%.
+ *
+ * A cycle ends at its first output commit, the later ones only toggle the
+ * pin. Times come from the caller, Timebase::now() on the robot and
+ * virtual time in the host simulator, so both give the same report.
+ */
+
+#ifndef LATENCYPROBE_H
+#define LATENCYPROBE_H
+
+#include <stdint.h>
+
+#define LATENCY_POLL_START 0
+#define LATENCY_FRAME_RX 1
+#define LATENCY_MIX_DONE 2
+#define LATENCY_OUTPUT_COMMIT 3
+#define LATENCY_EVENTS 4
+#define LATENCY_BUCKETS 41 //under 64 us, then 4 per octave up to 65 ms and over
+#define LATENCY_NO_PIN 0xFF
+
+class LatencyProbe
+{
+  public:
+    LatencyProbe();
+    void setPin(uint8_t, uint8_t);
+    void mark(uint8_t, uint32_t);
+    uint32_t percentile(uint8_t, uint8_t);
+    uint32_t worst(uint8_t);
+    uint16_t cycles();
+    void format(uint8_t, char *);
+    void reset();
+  private:
+    uint16_t histogram[LATENCY_EVENTS - 1][LATENCY_BUCKETS]; //per event after poll start
+    uint32_t _worst[LATENCY_EVENTS - 1];
+    uint16_t _cycles;
+    uint32_t start; //poll start of the open cycle
+    uint8_t seen; //events marked in the open cycle, one bit each
+#ifdef ARDUINO
+    volatile uint8_t *pinReg[LATENCY_EVENTS]; //writing the mask to PINx toggles the pin in one instruction
+    uint8_t pinMask[LATENCY_EVENTS];
+#endif
+};
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ * MotorCurve.cpp - Piecewise-linear speed to PWM map for one motor
+ * Part of ONI - Objeto Não Identificado
+ */
+
+#include "MotorCurve.h"
+
+//Straight line from the stall PWM to full power, both directions
+void MotorCurve::setLinear(uint8_t forwardStall, uint8_t reverseStall)
+{
+    setStall(MOTOR_CURVE_FORWARD, forwardStall);
+    setStall(MOTOR_CURVE_REVERSE, reverseStall);
+}
+
+//Straight line from the stall PWM to full power, one direction
+void MotorCurve::setStall(uint8_t direction, uint8_t stallPwm)
+{
+    for (uint8_t i = 0; i < MOTOR_CURVE_POINTS; i++)
+    {
+        knots[direction][i] = stallPwm + (uint16_t)(255 - stallPwm) * i / (MOTOR_CURVE_POINTS - 1);
+    }
+}
+
+uint8_t MotorCurve::stall(uint8_t direction)
+{
+    return knots[direction][0];
+}
+
+//Knots must never go down, or more speed would mean less power
+bool MotorCurve::valid()
+{
+    for (uint8_t d = 0; d < 2; d++)
+    {
+        for (uint8_t i = 1; i < MOTOR_CURVE_POINTS; i++)
+        {
+            if (knots[d][i] < knots[d][i - 1])
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+//Speed (-255~255) to PWM (-255~255). 0 stays 0
+int MotorCurve::apply(int speed)
+{
+    if (speed == 0)
+    {
+        return 0;
+    }
+    uint8_t direction = speed > 0 ? MOTOR_CURVE_FORWARD : MOTOR_CURVE_REVERSE;
+    uint16_t x = speed > 0 ? speed : -speed;
+    if (x > 255)
+    {
+        x = 255;
+    }
+    x += x >> 7; //stretch 0~255 to 0~256 so 255 lands exactly on the last knot
+    uint8_t segment = x >> 6; //knots are 64 apart
+    const uint8_t *k = knots[direction];
+    int pwm;
+    if (segment >= MOTOR_CURVE_POINTS - 1)
+    {
+        pwm = k[MOTOR_CURVE_POINTS - 1];
+    }
+    else
+    {
+        uint8_t fraction = x & 63;
+        pwm = k[segment] + (((int)(k[segment + 1] - k[segment]) * fraction) >> 6);
+    }
+    return speed > 0 ? pwm : -pwm;
+}
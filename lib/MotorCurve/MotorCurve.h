@@ -0,0 +1,32 @@
+/*
+ * MotorCurve.h - Piecewise-linear speed to PWM map for one motor
+ * Part of ONI - Objeto Não Identificado
+ *
+ * Each direction has MOTOR_CURVE_POINTS knots: the PWM needed for speeds
+ * 0+, 64, 128, 192 and 255. Knot 0 is the stall threshold, so any speed
+ * above 0 starts just past it and the wheel speed tracks the command
+ * linearly. apply() is integer only: a shift, a mask and one 8x8 multiply.
+ * The knots are plain bytes so the curve can be stored as is in EEPROM.
+ */
+
+#ifndef MOTORCURVE_H
+#define MOTORCURVE_H
+
+#include <stdint.h>
+
+#define MOTOR_CURVE_POINTS 5
+#define MOTOR_CURVE_FORWARD 0
+#define MOTOR_CURVE_REVERSE 1
+
+class MotorCurve
+{
+  public:
+    void setLinear(uint8_t, uint8_t);
+    void setStall(uint8_t, uint8_t);
+    uint8_t stall(uint8_t);
+    bool valid();
+    int apply(int);
+    uint8_t knots[2][MOTOR_CURVE_POINTS]; //[MOTOR_CURVE_FORWARD or MOTOR_CURVE_REVERSE][knot]
+};
+
+#endif
@@ -0,0 +1,153 @@
+/*
+ * PS2XBus.cpp - Several PS2 controllers sharing CLK, CMD and DAT
+ * Part of ONI - Objeto Não Identificado
+ */
+
+#include "Arduino.h"
+#include "PS2XBus.h"
+#include "Timebase.h"
+
+PS2XBus::PS2XBus(uint8_t _clk, uint8_t _cmd, uint8_t _dat)
+{
+    clk = _clk;
+    cmd = _cmd;
+    dat = _dat;
+    devices_count = 0;
+    _driver = 0;
+    cursor = 0;
+    stale = 500;
+}
+
+//Adds a controller on its own ATT pin. Returns its index, or -1 when the bus is full. The first one added drives until arbitration says otherwise
+int8_t PS2XBus::add(PS2X &pad, uint8_t att, uint8_t priority, uint16_t claim)
+{
+    if (devices_count == PS2X_BUS_DEVICES)
+    {
+        return -1;
+    }
+    PS2XDevice &device = devices[devices_count];
+    device.pad = &pad;
+    device.att = att;
+    device.priority = priority;
+    device.claim = claim;
+    device.lastGood = Timebase::ms();
+    device.lastRead = Timebase::ms();
+    return devices_count++;
+}
+
+//Deselects every controller. Must run before the first detect(), or an unconfigured ATT line may let two controllers drive DAT
+void PS2XBus::begin()
+{
+    for (uint8_t i = 0; i < devices_count; i++)
+    {
+        pinMode(devices[i].att, OUTPUT);
+        digitalWrite(devices[i].att, HIGH);
+    }
+}
+
+//Configures one controller, see PS2X::config_gamepad()
+byte PS2XBus::detect(uint8_t index)
+{
+    return devices[index].pad->config_gamepad(clk, cmd, devices[index].att, dat, false, false);
+}
+
+//Reads one controller
+void PS2XBus::read(uint8_t index)
+{
+    PS2XDevice &device = devices[index];
+    device.pad->read_gamepad();
+    device.lastRead = Timebase::ms();
+    if (device.pad->frameStatus() == PS2X_FRAME_OK)
+    {
+        device.lastGood = Timebase::ms();
+    }
+}
+
+//Reads the next controller that isn't driving, round-robin. One that isn't answering is only probed, and read
+//once it answers. Returns the index of the one read or probed, or -1 when none is due
+int8_t PS2XBus::next()
+{
+    for (uint8_t i = 1; i <= devices_count; i++) //the one read last time comes last
+    {
+        uint8_t index = (cursor + i) % devices_count;
+        PS2XDevice &device = devices[index];
+        if (index == _driver)
+        {
+            continue;
+        }
+        if (device.pad->frameStatus() != PS2X_FRAME_OK && Timebase::elapsedMs(device.lastRead) < PS2X_BUS_RETRY)
+        {
+            continue; //not answering, wait for its retry
+        }
+        cursor = index;
+        if (device.pad->frameStatus() != PS2X_FRAME_OK && !device.pad->probe_gamepad())
+        {
+            device.lastRead = Timebase::ms(); //still not answering
+            return index;
+        }
+        read(index);
+        return index;
+    }
+    return -1;
+}
+
+//Picks the driver from the last frames read. Returns its index
+uint8_t PS2XBus::arbitrate()
+{
+    int8_t best = -1;
+    for (uint8_t i = 0; i < devices_count; i++)
+    {
+        PS2XDevice &device = devices[i];
+        if (!fresh(i))
+        {
+            continue;
+        }
+        if (device.claim != 0 && (device.pad->ButtonDataByte() & device.claim) != device.claim) //1 = pressed
+        {
+            continue;
+        }
+        if (best < 0 || device.priority < devices[best].priority)
+        {
+            best = i;
+        }
+    }
+    if (best >= 0)
+    {
+        _driver = best;
+    }
+    return _driver;
+}
+
+//How long after its last good frame a controller may still drive, in ms
+void PS2XBus::setStale(uint16_t _stale)
+{
+    stale = _stale;
+}
+
+uint8_t PS2XBus::driver()
+{
+    return _driver;
+}
+
+uint8_t PS2XBus::count()
+{
+    return devices_count;
+}
+
+//The controller itself: buttons, sticks, frame status and counters of its last read
+PS2X &PS2XBus::pad(uint8_t index)
+{
+    return *devices[index].pad;
+}
+
+//ms since the last good frame of a controller
+unsigned long PS2XBus::age(uint8_t index)
+{
+    return Timebase::elapsedMs(devices[index].lastGood);
+}
+
+//The last frame of a controller is good and recent enough to drive
+boolean PS2XBus::fresh(uint8_t index)
+{
+    return devices[index].pad->frameStatus() == PS2X_FRAME_OK && age(index) <= stale;
+}
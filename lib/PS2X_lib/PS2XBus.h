@@ -0,0 +1,67 @@
+/*
+ * PS2XBus.h - Several PS2 controllers sharing CLK, CMD and DAT
+ * Part of ONI - Objeto Não Identificado
+ *
+ * Every controller has its own PS2X object, so its own ATT line, frame
+ * buffer and counters. The bus keeps every ATT line high while another
+ * controller is talking, decides which controller drives and splits the
+ * polling: the driver is read every control cycle, the others one per
+ * call of next(), so a second controller adds no bus time to the control
+ * path. A controller that isn't answering is only retried every
+ * PS2X_BUS_RETRY ms, and only read when a probe of its header shows it
+ * answers again: a read without an answer runs every retry and reconfig
+ * of read_gamepad(), about 8 ms, against about 150 us for the probe.
+ *
+ * Arbitration: among the controllers whose last frame is good and recent,
+ * the one with the lowest priority number that claims control drives. A
+ * controller claims while every button of its claim mask is held, or
+ * always with an empty mask. When none claims, the driver stays.
+ */
+
+#ifndef PS2XBUS_H
+#define PS2XBUS_H
+
+#include "Arduino.h"
+#include "PS2X_lib.h"
+
+#define PS2X_BUS_DEVICES 4
+#define PS2X_BUS_RETRY 1000 //ms between probes of a controller that isn't answering
+
+typedef struct
+{
+    PS2X *pad;
+    uint8_t att;
+    uint8_t priority; //lower wins
+    uint16_t claim; //PSB_* buttons held to claim control, 0 claims whenever its frames are good
+    unsigned long lastGood; //Timebase::ms() of the last PS2X_FRAME_OK
+    unsigned long lastRead; //Timebase::ms() of the last read
+} PS2XDevice;
+
+class PS2XBus
+{
+  public:
+    PS2XBus(uint8_t, uint8_t, uint8_t);
+    int8_t add(PS2X &, uint8_t, uint8_t, uint16_t);
+    void begin();
+    byte detect(uint8_t);
+    void read(uint8_t);
+    int8_t next();
+    uint8_t arbitrate();
+    void setStale(uint16_t);
+    uint8_t driver();
+    uint8_t count();
+    PS2X &pad(uint8_t);
+    unsigned long age(uint8_t);
+    boolean fresh(uint8_t);
+  private:
+    uint8_t clk;
+    uint8_t cmd;
+    uint8_t dat;
+    PS2XDevice devices[PS2X_BUS_DEVICES];
+    uint8_t devices_count;
+    uint8_t _driver;
+    uint8_t cursor; //last device read by next()
+    uint16_t stale; //ms after the last good frame a controller can't drive
+};
+
+#endif
@@ -0,0 +1,64 @@
+/*
+ * PS2XInput.cpp - InputSource on the controllers of a PS2XBus
+ * Part of ONI - Objeto Não Identificado
+ */
+
+#include "Arduino.h"
+#include "PS2XInput.h"
+
+static const uint8_t AXES[4] = {PSS_LX, PSS_LY, PSS_RX, PSS_RY}; //PS2 frame bytes of INPUT_LX~INPUT_RY
+
+//pad drives until the first read(), keep it the bus's first controller
+PS2XInput::PS2XInput(PS2XBus &_bus, PS2X &pad)
+{
+    bus = &_bus;
+    driving = &pad;
+}
+
+//Picks the controller that drives, see PS2XBus::arbitrate(). Its frame was just read by the sketch
+bool PS2XInput::read()
+{
+    driving = &bus->pad(bus->arbitrate());
+    return true;
+}
+
+uint8_t PS2XInput::status()
+{
+    switch (driving->frameStatus())
+    {
+        case PS2X_FRAME_OK:
+            return INPUT_OK;
+        case PS2X_FRAME_NO_RESPONSE:
+            return INPUT_LOST;
+        case PS2X_FRAME_BROWNOUT:
+            return INPUT_BROWNOUT;
+        default:
+            return INPUT_BAD; //wrong mode or length
+    }
+}
+
+uint8_t PS2XInput::analog(uint8_t stick)
+{
+    return driving->Analog(AXES[stick]);
+}
+
+uint16_t PS2XInput::buttons()
+{
+    return driving->ButtonDataByte();
+}
+
+uint16_t PS2XInput::lastButtons()
+{
+    return driving->LastButtonDataByte();
+}
+
+uint16_t PS2XInput::invalidStreak()
+{
+    return driving->stats().invalidStreak;
+}
+
+//Controller driving, for its link counters
+PS2X &PS2XInput::pad()
+{
+    return *driving;
+}
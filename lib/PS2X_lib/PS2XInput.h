@@ -0,0 +1,35 @@
+/*
+ * PS2XInput.h - InputSource on the controllers of a PS2XBus
+ * Part of ONI - Objeto Não Identificado
+ *
+ * The sketch still reads the bus itself (PS2XBus::read() and next()) and
+ * detects the controllers that went silent. read() follows the bus
+ * arbitration, and every accessor reads the last frame of the controller
+ * driving, so nothing is copied.
+ */
+
+#ifndef PS2XINPUT_H
+#define PS2XINPUT_H
+
+#include "Arduino.h"
+#include "PS2X_lib.h"
+#include "PS2XBus.h"
+#include "InputSource.h"
+
+class PS2XInput : public InputSource
+{
+  public:
+    PS2XInput(PS2XBus &, PS2X &);
+    bool read();
+    uint8_t status();
+    uint8_t analog(uint8_t);
+    uint16_t buttons();
+    uint16_t lastButtons();
+    uint16_t invalidStreak();
+    PS2X &pad();
+  private:
+    PS2XBus *bus;
+    PS2X *driving; //controller picked by the last arbitration
+};
+
+#endif
@@ -1,4 +1,6 @@
 #include "PS2X_lib.h"
+#include "Timebase.h"
+#include "IrqAudit.h"
 #include <math.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -47,6 +49,11 @@ unsigned int PS2X::ButtonDataByte() {
    return (~buttons);
 }
 
+/****************************************************************************************/
+unsigned int PS2X::LastButtonDataByte() {
+   return (~last_buttons);
+}
+
 /****************************************************************************************/
 byte PS2X::Analog(byte button) {
    return PS2data[button];
@@ -54,6 +61,7 @@ byte PS2X::Analog(byte button) {
 
 /****************************************************************************************/
 unsigned char PS2X::_gamepad_shiftinout (char byte) {
+   IRQ_AUDIT_SITE(IRQ_SITE_PS2X_SHIFT);
    unsigned char tmp = 0;
    for(unsigned char i=0;i<8;i++) {
       if(CHK(byte,i)) CMD_SET();
@@ -80,24 +88,57 @@ void PS2X::read_gamepad() {
    read_gamepad(false, 0x00);
 }
 
+/****************************************************************************************/
+// Clocks only the 3 byte header of a poll. A controller answers with the 0x5A ready marker
+// and drops the rest of the poll when ATT goes high. Without one, a full read_gamepad()
+// would go through every retry, reconfig and delay before giving up
+boolean PS2X::probe_gamepad() {
+   CMD_SET();
+   CLK_SET();
+   ATT_CLR(); // low enable joystick
+
+   delayMicroseconds(CTRL_BYTE_DELAY);
+   _gamepad_shiftinout(0x01);
+   _gamepad_shiftinout(0x42);
+   byte ready = _gamepad_shiftinout(0x00);
+
+   ATT_SET(); // HI disable joystick
+   return ready == 0x5A;
+}
+
 /****************************************************************************************/
 boolean PS2X::read_gamepad(boolean motor1, byte motor2) {
-   double temp = millis() - last_read;
+   IRQ_AUDIT_SITE(IRQ_SITE_PS2X_READ);
+   unsigned long waited = Timebase::elapsedMs(last_read);
 
-   if (temp > 1500) //waited to long
+   if (waited > 1500) { //waited to long
+      _stats.timeoutReconfigs++;
       reconfig_gamepad();
+   }
 
-   if(temp < read_delay)  //waited too short
-      delay(read_delay - temp);
+   if(waited < read_delay) {  //waited too short
+      // the read before was at most read_delay ms ago, so the us stamp can't have wrapped.
+      // delayMicroseconds() is only accurate up to 16383 us: whole ms go to delay()
+      unsigned long waited_us = Timebase::elapsedUs(last_read_us);
+      if(waited_us < read_delay * 1000UL) {
+         unsigned long rest = read_delay * 1000UL - waited_us;
+         delay(rest / 1000);
+         delayMicroseconds(rest % 1000);
+      }
+   }
 
    if(motor2 != 0x00)
       motor2 = map(motor2,0,255,0x40,0xFF); //noting below 40 will make it spin
 
    char dword[9] = {0x01,0x42,0,motor1,motor2,0,0,0,0};
    byte dword2[12] = {0,0,0,0,0,0,0,0,0,0,0,0};
+   byte clocked;
 
    // Try a few times to get valid data...
    for (byte RetryCnt = 0; RetryCnt < 5; RetryCnt++) {
+      if (RetryCnt > 0)
+         _stats.retries++;
+
       CMD_SET();
       CLK_SET();
       ATT_CLR(); // low enable joystick
@@ -107,18 +148,21 @@ boolean PS2X::read_gamepad(boolean motor1, byte motor2) {
       for (int i = 0; i<9; i++) {
          PS2data[i] = _gamepad_shiftinout(dword[i]);
       }
+      clocked = 9;
 
       if(PS2data[1] == 0x79) {  //if controller is in full data return mode, get the rest of data
          for (int i = 0; i<12; i++) {
             PS2data[i+9] = _gamepad_shiftinout(dword2[i]);
          }
+         clocked = 21;
       }
 
       ATT_SET(); // HI disable joystick
-      // Check to see if we received valid data or not.  
-	  // We should be in analog mode for our data to be valid (analog == 0x7_)
-      if ((PS2data[1] & 0xf0) == 0x70)
-         break;
+      // Check to see if we received a well formed frame or not.
+      // We should be in analog mode for our data to be valid (analog == 0x7_)
+      frame_status = checkFrame(clocked);
+      if (frame_status == PS2X_FRAME_OK || frame_status == PS2X_FRAME_BROWNOUT)
+         break; // a brown-out frame is well formed, retrying or reconfiguring won't fix the supply
 
       // If we got to here, we are not in analog mode, try to recover...
       reconfig_gamepad(); // try to get back into Analog mode.
@@ -155,8 +199,58 @@ boolean PS2X::read_gamepad(boolean motor1, byte motor2) {
 #else
    buttons =  (uint16_t)(PS2data[4] << 8) + PS2data[3];   //store as one value for multiple functions
 #endif
-   last_read = millis();
-   return ((PS2data[1] & 0xf0) == 0x70);  // 1 = OK = analog mode - 0 = NOK
+   last_read = Timebase::ms();
+   last_read_us = Timebase::now();
+   _stats.frames++;
+   if (frame_status == PS2X_FRAME_OK) {
+      _stats.invalidStreak = 0;
+   }
+   else {
+      _stats.invalid[frame_status]++;
+      _stats.invalidStreak++;
+      if (_stats.invalidStreak > _stats.longestInvalidStreak)
+         _stats.longestInvalidStreak = _stats.invalidStreak;
+   }
+   return (frame_status == PS2X_FRAME_OK);  // 1 = OK = well formed analog frame - 0 = NOK
+}
+
+/****************************************************************************************/
+byte PS2X::checkFrame(byte clocked) {
+   // Byte 2 is the 0x5A ready marker. Without it nothing answered: DAT floats high (all 0xFF) or is held low (all 0x00)
+   if (PS2data[2] != 0x5A)
+      return PS2X_FRAME_NO_RESPONSE;
+
+   // High nibble of byte 1 is the mode, low nibble the payload length in 16 bit words
+   switch (PS2data[1] & 0xf0) {
+      case 0x70:
+         break;
+      case 0x40:
+         return PS2X_FRAME_NOT_ANALOG;
+      default:
+         return PS2X_FRAME_BAD_MODE;
+   }
+   if (3 + 2*(PS2data[1] & 0x0f) != clocked)
+      return PS2X_FRAME_BAD_LENGTH;
+
+   if (en_Brownout) {
+      // When logic voltage sags the controller keeps framing correctly but reports every button
+      // pressed (active low, so 0x0000) or parks all four sticks at 115
+      if (PS2data[3] == 0x00 && PS2data[4] == 0x00)
+         return PS2X_FRAME_BROWNOUT;
+      if (PS2data[PSS_RX] == 115 && PS2data[PSS_RY] == 115 && PS2data[PSS_LX] == 115 && PS2data[PSS_LY] == 115)
+         return PS2X_FRAME_BROWNOUT;
+   }
+   return PS2X_FRAME_OK;
+}
+
+/****************************************************************************************/
+byte PS2X::frameStatus() {
+   return frame_status;
+}
+
+/****************************************************************************************/
+void PS2X::enableBrownoutDetect(boolean enable) {
+   en_Brownout = enable;
 }
 
 /****************************************************************************************/
@@ -166,9 +260,12 @@ byte PS2X::config_gamepad(uint8_t clk, uint8_t cmd, uint8_t att, uint8_t dat) {
 
 /****************************************************************************************/
 byte PS2X::config_gamepad(uint8_t clk, uint8_t cmd, uint8_t att, uint8_t dat, bool pressures, bool rumble) {
+  IRQ_AUDIT_SITE(IRQ_SITE_PS2X_CONFIG);
 
   byte temp[sizeof(type_read)];
 
+  _stats.detections++;
+
 #ifdef __AVR__
   _clk_mask = digitalPinToBitMask(clk);
   _clk_oreg = portOutputRegister(digitalPinToPort(clk));
@@ -374,6 +471,8 @@ bool PS2X::enablePressures() {
 
 /****************************************************************************************/
 void PS2X::reconfig_gamepad(){
+  IRQ_AUDIT_SITE(IRQ_SITE_PS2X_CONFIG);
+  _stats.reconfigs++;
   sendCommandString(enter_config, sizeof(enter_config));
   sendCommandString(set_mode, sizeof(set_mode));
   if (en_Rumble)
@@ -383,6 +482,16 @@ void PS2X::reconfig_gamepad(){
   sendCommandString(exit_config, sizeof(exit_config));
 }
 
+/****************************************************************************************/
+const PS2X_Stats &PS2X::stats() {
+  return _stats;
+}
+
+/****************************************************************************************/
+void PS2X::resetStats() {
+  memset(&_stats, 0, sizeof(_stats));
+}
+
 /****************************************************************************************/
 #ifdef __AVR__
 inline void  PS2X::CLK_SET(void) {
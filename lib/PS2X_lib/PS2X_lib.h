@@ -76,6 +76,7 @@ GNU General Public License for more details.
 // to debug ps2 controller, uncomment these two lines to print out debug to uart
 //#define PS2X_DEBUG
 //#define PS2X_COM_DEBUG
+// the benchmark build (see platformio.ini, env:bench) defines PS2X_BENCH to reach private members
 
 #ifndef PS2X_lib_h
   #define PS2X_lib_h
@@ -94,6 +95,9 @@ GNU General Public License for more details.
   #include <avr/io.h>
   #define CTRL_CLK        4
   #define CTRL_BYTE_DELAY 3
+  #ifndef PS2X_PORT
+    #define PS2X_PORT volatile uint8_t // port register type. The host emulator (tools/sim) swaps in one that sees every access
+  #endif
 #else
   // Pic32...
   #include <pins_arduino.h>
@@ -159,6 +163,27 @@ GNU General Public License for more details.
 #define PSAB_CROSS       15
 #define PSAB_SQUARE      16
 
+//These are frame status codes, see frameStatus()
+#define PS2X_FRAME_OK           0  //ready byte, mode and length all check out
+#define PS2X_FRAME_NO_RESPONSE  1  //no 0x5A ready byte, nothing is driving DAT
+#define PS2X_FRAME_BAD_MODE     2  //mode byte is neither digital (0x4_) nor analog (0x7_)
+#define PS2X_FRAME_NOT_ANALOG   3  //controller answered in digital mode
+#define PS2X_FRAME_BAD_LENGTH   4  //mode byte announces a length other than the one clocked
+#define PS2X_FRAME_BROWNOUT     5  //well formed, but carries a low logic voltage pattern. See enableBrownoutDetect()
+#define PS2X_FRAME_STATUSES     6
+
+//Link quality counters. Plain increments, cheap enough to keep always on
+typedef struct {
+  uint32_t frames;                        //read_gamepad() transactions
+  uint16_t retries;                       //extra attempts inside read_gamepad()'s retry loop
+  uint16_t reconfigs;                     //reconfig_gamepad() calls, for any reason
+  uint16_t timeoutReconfigs;              //reconfigs caused by not being polled for 1500 ms
+  uint16_t invalid[PS2X_FRAME_STATUSES];  //frames returned by read_gamepad(), by status. [PS2X_FRAME_OK] stays 0
+  uint16_t detections;                    //config_gamepad() calls
+  uint16_t invalidStreak;                 //current run of invalid frames
+  uint16_t longestInvalidStreak;          //longest run of invalid frames
+} PS2X_Stats;
+
 #define SET(x,y) (x|=(1<<y))
 #define CLR(x,y) (x&=(~(1<<y)))
 #define CHK(x,y) (x & (1<<y))
@@ -168,12 +193,14 @@ class PS2X {
   public:
     boolean Button(uint16_t);                //will be TRUE if button is being pressed
     unsigned int ButtonDataByte();
+    unsigned int LastButtonDataByte();       //ButtonDataByte() before the last read_gamepad()
     boolean NewButtonState();
     boolean NewButtonState(unsigned int);    //will be TRUE if button was JUST pressed OR released
     boolean ButtonPressed(unsigned int);     //will be TRUE if button was JUST pressed
     boolean ButtonReleased(unsigned int);    //will be TRUE if button was JUST released
     void read_gamepad();
     boolean  read_gamepad(boolean, byte);
+    boolean probe_gamepad();                 //will be TRUE if a controller answers on ATT. Reads nothing, about 150 us
     byte readType();
     byte config_gamepad(uint8_t, uint8_t, uint8_t, uint8_t);
     byte config_gamepad(uint8_t, uint8_t, uint8_t, uint8_t, bool, bool);
@@ -181,8 +208,15 @@ class PS2X {
     bool enablePressures();
     byte Analog(byte);
     void reconfig_gamepad();
+    byte frameStatus();                      //PS2X_FRAME_* status of the last frame read
+    void enableBrownoutDetect(boolean);      //flag all-buttons-pressed and all-115 frames as PS2X_FRAME_BROWNOUT
+    const PS2X_Stats &stats();
+    void resetStats();
 
   private:
+#ifdef PS2X_BENCH
+    friend class PS2XBench; //cycle benchmarks reach into the frame buffer and the bit-bang loop
+#endif
     inline void CLK_SET(void);
     inline void CLK_CLR(void);
     inline void CMD_SET(void);
@@ -192,6 +226,7 @@ class PS2X {
     inline bool DAT_CHK(void);
     
     unsigned char _gamepad_shiftinout (char);
+    byte checkFrame(byte);
     unsigned char PS2data[21];
     void sendCommandString(byte*, byte);
     unsigned char i;
@@ -201,13 +236,13 @@ class PS2X {
     #ifdef __AVR__
       uint8_t maskToBitNum(uint8_t);
       uint8_t _clk_mask; 
-      volatile uint8_t *_clk_oreg;
+      PS2X_PORT *_clk_oreg;
       uint8_t _cmd_mask; 
-      volatile uint8_t *_cmd_oreg;
+      PS2X_PORT *_cmd_oreg;
       uint8_t _att_mask; 
-      volatile uint8_t *_att_oreg;
+      PS2X_PORT *_att_oreg;
       uint8_t _dat_mask; 
-      volatile uint8_t *_dat_ireg;
+      PS2X_PORT *_dat_ireg;
     #else
       uint8_t maskToBitNum(uint8_t);
       uint16_t _clk_mask; 
@@ -223,11 +258,15 @@ class PS2X {
       volatile uint32_t *_dat_lport;
     #endif
 	
-    unsigned long last_read;
+    unsigned long last_read; //Timebase::ms(), wraps after 49 days
+    unsigned long last_read_us; //Timebase::now() of the same read, for the sub-ms rest of read_delay
     byte read_delay;
     byte controller_type;
     boolean en_Rumble;
     boolean en_Pressures;
+    boolean en_Brownout;
+    byte frame_status;
+    PS2X_Stats _stats;
 };
 
 #endif
@@ -0,0 +1,228 @@
+/*
+ * Scheduler.cpp - Multi-rate cooperative task scheduler
+ * Part of ONI - Objeto Não Identificado
+ */
+
+#include "Arduino.h"
+#include <avr/sleep.h>
+#include "Scheduler.h"
+#include "Timebase.h"
+#include "IrqAudit.h"
+
+//tasks: the task table, count: how many tasks there are (up to SCHEDULER_MAX_TASKS)
+Scheduler::Scheduler(Task *_tasks, uint8_t _count)
+{
+    tasks = _tasks;
+    count = min(_count, SCHEDULER_MAX_TASKS);
+    sleeping = true;
+    breadcrumb = NULL;
+}
+
+//Releases every task now and starts the first frame. frame: frame length in ms
+void Scheduler::begin(uint16_t frame)
+{
+    //Order the tasks by priority once, so runFrame() just walks the list
+    for (uint8_t i = 0; i < count; i++)
+    {
+        uint8_t j = i;
+        while (j > 0 and tasks[order[j - 1]].priority > tasks[i].priority)
+        {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+    setFrame(frame);
+    frameStart = Timebase::now();
+    for (uint8_t i = 0; i < count; i++)
+    {
+        tasks[i].release = frameStart;
+    }
+    resetStats();
+}
+
+void Scheduler::setFrame(uint16_t frame)
+{
+    frameLength = frame * 1000UL;
+}
+
+//Changes a task period. The next release is pulled in if it's further away than the new period
+void Scheduler::setPeriod(uint8_t index, uint16_t period)
+{
+    Task &t = tasks[index];
+    unsigned long limit = Timebase::now() + period * 1000UL;
+    if (long(t.release - limit) > 0)
+    {
+        t.release = limit;
+    }
+    t.period = period;
+}
+
+//Runs the due tasks of the current frame in priority order
+void Scheduler::runFrame()
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        Task &t = tasks[order[i]];
+        unsigned long now = Timebase::now();
+        if (long(now - t.release) < 0)
+        {
+            continue; //not due
+        }
+
+        unsigned long used = now - frameStart;
+        if (t.policy != TASK_CRITICAL and used + t.budget > frameLength) //would overrun the frame
+        {
+            if (t.policy == TASK_DEFER)
+            {
+                t.deferred++;
+            }
+            else
+            {
+                t.skipped++;
+                t.release += t.period * 1000UL;
+            }
+            continue;
+        }
+
+        if (now - t.release > frameLength)
+        {
+            t.late++;
+        }
+        if (breadcrumb)
+        {
+            *breadcrumb = order[i];
+        }
+        t.run();
+        unsigned long runTime = Timebase::now() - now;
+        t.runs++;
+        if (runTime > t.budget)
+        {
+            t.overBudget++;
+        }
+        if (runTime > t.worst)
+        {
+            t.worst = min(runTime, 0xFFFFUL);
+        }
+
+        //Next release. A task a whole period behind drops the releases it missed instead of bursting
+        t.release += t.period * 1000UL;
+        while (long(Timebase::now() - t.release) >= long(t.period * 1000UL))
+        {
+            t.release += t.period * 1000UL;
+            t.skipped++;
+        }
+    }
+
+    unsigned long busy = Timebase::now() - frameStart;
+    lastFrameTime = min(busy, 0xFFFFUL);
+    if (lastFrameTime > worstFrame)
+    {
+        worstFrame = lastFrameTime;
+    }
+    if (busy > frameLength)
+    {
+        frameOverruns++;
+    }
+}
+
+//Waits for the next frame to start. Frames are kept on a fixed grid, unless a frame overran a whole frame
+//The CPU idles until an interrupt while more than SCHEDULER_SLEEP_GUARD is left: the Timebase compare on Timer5
+//wakes it at least every 1000 us, and the last stretch is spun so the frame isn't started up to a tick late
+void Scheduler::waitFrame()
+{
+    IRQ_AUDIT_SITE(IRQ_SITE_WAIT);
+    if (breadcrumb)
+    {
+        *breadcrumb = SCHEDULER_WAITING;
+    }
+    frameStart += frameLength;
+    if (long(Timebase::now() - frameStart) >= long(frameLength))
+    {
+        frameStart = Timebase::now(); //too far behind, start over from now
+        return;
+    }
+    if (sleeping)
+    {
+        set_sleep_mode(SLEEP_MODE_IDLE); //timers, ADC and UARTs keep running
+        while (true)
+        {
+            cli(); //an interrupt between the check and the sleep would leave us asleep until the next one
+            if (long(Timebase::now() - frameStart) > -long(SCHEDULER_SLEEP_GUARD))
+            {
+                sei();
+                break;
+            }
+            sleep_enable();
+            sei(); //the instruction after sei() still runs with interrupts off, so nothing wakes us before we sleep
+            sleep_cpu();
+            sleep_disable();
+        }
+    }
+    while (long(Timebase::now() - frameStart) < 0)
+    {
+        ; //we still got some time to waste
+    }
+    unsigned long wake = Timebase::now() - frameStart;
+    if (wake > worstWake)
+    {
+        worstWake = min(wake, 0xFFFFUL);
+    }
+}
+
+//Sleeps between frames, or spins like it used to when off
+void Scheduler::setSleep(bool enabled)
+{
+    sleeping = enabled;
+}
+
+Task &Scheduler::task(uint8_t index)
+{
+    return tasks[index];
+}
+
+//Busy time of the last frame, in us
+uint16_t Scheduler::frameTime()
+{
+    return lastFrameTime;
+}
+
+//Longest busy frame since resetWorstFrameTime(), in us
+uint16_t Scheduler::worstFrameTime()
+{
+    return worstFrame;
+}
+
+void Scheduler::resetWorstFrameTime()
+{
+    worstFrame = 0;
+}
+
+//Where to write the index of the task about to run, SCHEDULER_WAITING between frames. For a
+//watchdog to tell at boot what hung
+void Scheduler::setBreadcrumb(volatile uint8_t *stage)
+{
+    breadcrumb = stage;
+}
+
+//Longest delay between a frame being due and waitFrame() returning, in us
+uint16_t Scheduler::wakeLatency()
+{
+    return worstWake;
+}
+
+//Frames that took longer than the frame length
+uint16_t Scheduler::overruns()
+{
+    return frameOverruns;
+}
+
+void Scheduler::resetStats()
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        Task &t = tasks[i];
+        t.runs = t.late = t.deferred = t.skipped = t.overBudget = t.worst = 0;
+    }
+    lastFrameTime = worstFrame = frameOverruns = worstWake = 0;
+}
@@ -0,0 +1,76 @@
+/*
+ * Scheduler.h - Multi-rate cooperative task scheduler
+ * Part of ONI - Objeto Não Identificado
+ *
+ * Time is cut in fixed frames. Every frame, the tasks that are due run in
+ * priority order. Before starting a task the scheduler checks its budget
+ * against what's left of the frame: critical tasks always run, the others
+ * are deferred to a later frame or have this release skipped, so a heavy
+ * frame pushes back telemetry instead of overrunning the control path.
+ * Between frames the CPU sleeps in idle mode, see waitFrame().
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "Arduino.h"
+
+#define SCHEDULER_MAX_TASKS 12
+#define SCHEDULER_SLEEP_GUARD 1100 //us before a frame when sleeping stops. A bit over a Timebase tick
+#define SCHEDULER_WAITING 0xFE //breadcrumb between frames, otherwise it holds the running task index
+
+//Overrun policies
+#define TASK_CRITICAL 0 //always runs, even if it overruns the frame
+#define TASK_DEFER    1 //waits for a frame with enough time left, the release is kept
+#define TASK_SKIP     2 //this release is dropped, runs again next period
+
+typedef struct {
+    //Set up by the sketch
+    void (*run)();
+    uint16_t period;       //ms between releases
+    uint8_t priority;      //lower runs first
+    uint16_t budget;       //expected worst run time, in us
+    uint8_t policy;        //TASK_CRITICAL, TASK_DEFER or TASK_SKIP
+    //Kept by the scheduler
+    unsigned long release; //Timebase::now() of the next release
+    uint16_t runs;
+    uint16_t late;         //runs started more than a frame after their release
+    uint16_t deferred;     //frames the task waited for lack of time
+    uint16_t skipped;      //releases dropped, for lack of time or for falling a whole period behind
+    uint16_t overBudget;   //runs that took longer than budget
+    uint16_t worst;        //longest run, in us
+} Task;
+
+class Scheduler
+{
+  public:
+    Scheduler(Task *, uint8_t);
+    void begin(uint16_t);
+    void setFrame(uint16_t);
+    void setPeriod(uint8_t, uint16_t);
+    void runFrame();
+    void waitFrame();
+    void setSleep(bool);
+    void setBreadcrumb(volatile uint8_t *);
+    Task &task(uint8_t);
+    uint16_t frameTime();
+    uint16_t worstFrameTime();
+    void resetWorstFrameTime();
+    uint16_t overruns();
+    uint16_t wakeLatency();
+    void resetStats();
+  private:
+    Task *tasks;
+    uint8_t count;
+    uint8_t order[SCHEDULER_MAX_TASKS]; //task indexes by priority
+    unsigned long frameLength; //us
+    unsigned long frameStart; //Timebase::now() of the current frame
+    uint16_t lastFrameTime;
+    uint16_t worstFrame;
+    uint16_t frameOverruns;
+    uint16_t worstWake; //us
+    bool sleeping;
+    volatile uint8_t *breadcrumb; //NULL for none
+};
+
+#endif
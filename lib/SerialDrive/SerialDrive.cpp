@@ -0,0 +1,239 @@
+/*
+ * SerialDrive.cpp - Drive commands from a host over USART1
+ * Part of ONI - Objeto Não Identificado
+ */
+
+#include "Arduino.h"
+#include <util/atomic.h>
+#include <util/crc16.h>
+#include "SerialDrive.h"
+#include "Handoff.h"
+#include "Timebase.h"
+#include "IrqAudit.h"
+
+//Receive side, only touched by the interrupt
+static uint8_t frame[SERIAL_DRIVE_FRAME]; //frame being received, frame[0] is the sync
+static uint8_t received; //bytes of it so far, 0 while hunting for a sync
+static uint8_t crc; //of the bytes after the sync so far, not counting the crc byte
+static uint16_t arrivedCount;
+//Written by the interrupt, read and cleared with interrupts off
+static uint32_t goodFrames;
+static uint16_t badChecksum;
+static uint16_t serialErrors;
+static Seqlock<SerialDriveCommand> latest; //newest good frame
+
+//After a bad crc, restarts the frame at the first sync past the old one, so a frame cut short by a
+//host restart or a noisy byte doesn't take the next good one down with it
+static void resync()
+{
+    for (uint8_t start = 1; start < SERIAL_DRIVE_FRAME; start++)
+    {
+        if (frame[start] == SERIAL_DRIVE_SYNC)
+        {
+            received = SERIAL_DRIVE_FRAME - start;
+            crc = 0;
+            for (uint8_t i = 0; i < received; i++)
+            {
+                frame[i] = frame[start + i];
+                if (i > 0)
+                {
+                    crc = _crc8_ccitt_update(crc, frame[i]);
+                }
+            }
+            return;
+        }
+    }
+    received = 0;
+}
+
+ISR(USART1_RX_vect)
+{
+    IRQ_AUDIT_ISR(IRQ_ISR_SERIAL_DRIVE, 0);
+    uint8_t flags = UCSR1A; //before UDR1, reading it moves the queue on
+    uint8_t data = UDR1;
+    if (flags & ((1 << FE1) | (1 << DOR1)))
+    {
+        serialErrors++;
+        received = 0;
+        return;
+    }
+    if (received == 0)
+    {
+        if (data == SERIAL_DRIVE_SYNC)
+        {
+            frame[0] = data;
+            received = 1;
+            crc = 0;
+        }
+        return;
+    }
+    frame[received++] = data;
+    if (received < SERIAL_DRIVE_FRAME)
+    {
+        crc = _crc8_ccitt_update(crc, data);
+        return;
+    }
+    if (data != crc)
+    {
+        badChecksum++;
+        resync();
+        return;
+    }
+    received = 0;
+    SerialDriveCommand newest;
+    newest.arrived = ++arrivedCount;
+    newest.seq = frame[1];
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        newest.sticks[i] = frame[2 + i];
+    }
+    newest.buttons = frame[6] | (frame[7] << 8);
+    newest.time = Timebase::now();
+    latest.write(newest);
+    goodFrames++;
+}
+
+SerialDrive::SerialDrive()
+{
+    memset(&command, 0, sizeof(command));
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        command.sticks[i] = 128; //centred until a command comes
+    }
+    started = false;
+    previousButtons = 0;
+    _status = INPUT_LOST;
+    streak = 0;
+    timeout = SERIAL_DRIVE_TIMEOUT;
+    dropped = 0;
+    timeouts = 0;
+    errorsSeen = 0;
+}
+
+//Takes USART1 over at baud, 8N1, receive only
+void SerialDrive::begin(unsigned long baud)
+{
+    uint8_t sreg = SREG;
+    cli();
+    UCSR1B = 0;
+    UCSR1A = (1 << U2X1);
+    UBRR1 = (F_CPU / 4 / baud - 1) / 2; //double speed, rounded the way HardwareSerial does
+    UCSR1C = (1 << UCSZ11) | (1 << UCSZ10);
+    received = 0;
+    UCSR1B = (1 << RXEN1) | (1 << RXCIE1);
+    SREG = sreg;
+}
+
+//ms after its last byte a command goes stale
+void SerialDrive::setTimeout(uint16_t ms)
+{
+    timeout = ms;
+}
+
+//Takes the newest command. True when one came in since the last read()
+bool SerialDrive::read()
+{
+    previousButtons = command.buttons;
+    SerialDriveCommand newest;
+    latest.read(newest);
+    bool taken = newest.arrived != command.arrived;
+    if (taken)
+    {
+        uint16_t got = newest.arrived - command.arrived; //includes the ones overwritten before this read()
+        uint8_t sent = newest.seq - command.seq;
+        if (started && got < 256 && sent > got)
+        {
+            dropped += sent - got;
+        }
+        command = newest;
+        started = true;
+    }
+
+    uint16_t errors;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        errors = badChecksum + serialErrors;
+    }
+    uint8_t now;
+    if (started && Timebase::elapsedUs(command.time) <= timeout * 1000UL)
+    {
+        now = INPUT_OK;
+    }
+    else
+    {
+        now = errors != errorsSeen ? INPUT_BAD : INPUT_LOST; //bytes come in, but no good frame
+    }
+    errorsSeen = errors;
+    if (now != INPUT_OK && _status == INPUT_OK)
+    {
+        timeouts++;
+    }
+    _status = now;
+    if (now == INPUT_OK)
+    {
+        streak = 0;
+    }
+    else if (streak < 0xFFFF)
+    {
+        streak++;
+    }
+    return taken;
+}
+
+uint8_t SerialDrive::status()
+{
+    return _status;
+}
+
+uint8_t SerialDrive::analog(uint8_t stick)
+{
+    return command.sticks[stick];
+}
+
+uint16_t SerialDrive::buttons()
+{
+    return command.buttons;
+}
+
+uint16_t SerialDrive::lastButtons()
+{
+    return previousButtons;
+}
+
+uint16_t SerialDrive::invalidStreak()
+{
+    return streak;
+}
+
+//Timebase::now() of the last byte of the command in use, for latency from the host
+uint32_t SerialDrive::arrival()
+{
+    return command.time;
+}
+
+SerialDriveStats SerialDrive::stats()
+{
+    SerialDriveStats copy;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        copy.frames = goodFrames;
+        copy.badChecksum = badChecksum;
+        copy.serialErrors = serialErrors;
+    }
+    copy.dropped = dropped;
+    copy.timeouts = timeouts;
+    return copy;
+}
+
+void SerialDrive::resetStats()
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        goodFrames = 0;
+        badChecksum = 0;
+        serialErrors = 0;
+    }
+    errorsSeen = 0;
+    dropped = 0;
+    timeouts = 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * SerialDrive.h - Drive commands from a host over USART1
+ * Part of ONI - Objeto Não Identificado
+ *
+ * A host drives the robot the way a PS2 controller would, with compact
+ * binary frames on USART1 (RX1 is pin 19). USART0 is the console, and the
+ * pins of USART2 and USART3 carry the PS2 bus. Every frame is 9 bytes:
+ *
+ *   0xA5 seq lx ly rx ry buttonsLow buttonsHigh crc
+ *
+ * seq goes up by one with every frame the host sends, wrapping at 256.
+ * Sticks and buttons use the PS2 layout (see InputSource.h), buttons with
+ * 1 = pressed. crc is CRC-8 with polynomial 0x07 starting at 0, over seq
+ * to buttonsHigh. tools/drive.py sends them.
+ *
+ * The receive interrupt parses each byte as it comes, into a fixed frame
+ * buffer, and publishes every frame whose crc checks out through a
+ * Seqlock (see Handoff.h) with the Timebase::now() of its last byte. A bad
+ * crc drops the frame and starts again from the next 0xA5 already in the
+ * buffer, if any. A framing or overrun error drops it and waits for the
+ * next 0xA5. Nothing is allocated and interrupts are never turned off.
+ *
+ * read() takes the newest command. Frames overwritten before a read()
+ * only came faster than the control cycle. The seq gaps beyond them are
+ * frames lost on the wire, counted as dropped. A host restarting its seq
+ * also shows up as a gap. A command older than the timeout leaves the
+ * source INPUT_LOST, so a host that stops sending stops the robot the way
+ * a lost controller does.
+ *
+ * There is only one USART1, so only one SerialDrive. Serial1 must not be
+ * used anywhere, as its interrupt would clash with this one.
+ */
+
+#ifndef SERIALDRIVE_H
+#define SERIALDRIVE_H
+
+#include "Arduino.h"
+#include "InputSource.h"
+
+#define SERIAL_DRIVE_SYNC 0xA5
+#define SERIAL_DRIVE_FRAME 9 //bytes, sync to crc
+#define SERIAL_DRIVE_TIMEOUT 100 //default ms before the last command goes stale
+
+typedef struct
+{
+    uint16_t arrived; //good frames received up to this one, wraps
+    uint8_t seq;
+    uint8_t sticks[4]; //INPUT_LX~INPUT_RY
+    uint16_t buttons;
+    uint32_t time; //Timebase::now() at its last byte
+} SerialDriveCommand;
+
+typedef struct
+{
+    uint32_t frames; //good frames received
+    uint16_t badChecksum;
+    uint16_t serialErrors; //bytes with a framing or overrun error
+    uint16_t dropped; //frames missing from the seq count
+    uint16_t timeouts; //times the source stopped being INPUT_OK
+} SerialDriveStats;
+
+class SerialDrive : public InputSource
+{
+  public:
+    SerialDrive();
+    void begin(unsigned long);
+    void setTimeout(uint16_t);
+    bool read();
+    uint8_t status();
+    uint8_t analog(uint8_t);
+    uint16_t buttons();
+    uint16_t lastButtons();
+    uint16_t invalidStreak();
+    uint32_t arrival();
+    SerialDriveStats stats();
+    void resetStats();
+  private:
+    SerialDriveCommand command; //in use since the last read()
+    bool started; //a command was taken since begin()
+    uint16_t previousButtons;
+    uint8_t _status;
+    uint16_t streak;
+    uint16_t timeout;
+    uint16_t dropped;
+    uint16_t timeouts;
+    uint16_t errorsSeen; //bad frames and serial errors at the last read()
+};
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ * StackMonitor.cpp - Stack high-water mark through stack painting
+ * Part of ONI - Objeto Não Identificado
+ */
+
+#include "Arduino.h"
+#include "StackMonitor.h"
+
+#define STACK_CANARY 0xC5
+
+extern uint8_t _end; //end of .bss/.noinit, the heap starts here
+extern uint8_t __stack; //top of RAM, the stack starts here
+extern char *__brkval; //top of the heap, 0 while malloc() was never used
+
+//Paints _end ~ __stack with STACK_CANARY. Runs from .init1, before the stack pointer is even set up,
+//so it's naked and written in assembly: nothing may be pushed or called
+void StackPaint(void) __attribute__ ((naked, used, section (".init1")));
+
+void StackPaint(void)
+{
+    __asm volatile (
+        "    ldi r30, lo8(_end)\n"
+        "    ldi r31, hi8(_end)\n"
+        "    ldi r24, %0\n"
+        "    ldi r25, hi8(__stack)\n"
+        "    rjmp 2f\n"
+        "1:  st Z+, r24\n"
+        "2:  cpi r30, lo8(__stack)\n"
+        "    cpc r31, r25\n"
+        "    brlo 1b\n"
+        "    breq 1b\n"
+        :: "M" (STACK_CANARY));
+}
+
+//Least free stack since boot, in bytes. Counts canaries up from the top of the heap, so it costs
+//a few cycles per free byte: call it at a low rate
+uint16_t StackMonitor::minFree()
+{
+    const uint8_t *p = __brkval ? (const uint8_t *)__brkval : &_end;
+    const uint8_t *top = &__stack;
+    uint16_t count = 0;
+    while (p <= top && *p == STACK_CANARY)
+    {
+        p++;
+        count++;
+    }
+    return count;
+}
+
+//Free stack right now, in bytes: distance between the stack pointer and the top of the heap
+uint16_t StackMonitor::currentFree()
+{
+    uint8_t here; //lives at the current stack depth
+    const uint8_t *heapTop = __brkval ? (const uint8_t *)__brkval : &_end;
+    return &here - heapTop;
+}
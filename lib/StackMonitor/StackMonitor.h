@@ -0,0 +1,23 @@
+/*
+ * StackMonitor.h - Stack high-water mark through stack painting
+ * Part of ONI - Objeto Não Identificado
+ *
+ * Before main() runs, every byte between the end of static data and the
+ * top of RAM is painted with a canary value. Whatever the stack (or the
+ * heap) ever touches loses the canary, so counting the canaries still
+ * standing above the heap tells the least free stack since boot.
+ */
+
+#ifndef STACKMONITOR_H
+#define STACKMONITOR_H
+
+#include "Arduino.h"
+
+class StackMonitor
+{
+  public:
+    static uint16_t minFree();
+    static uint16_t currentFree();
+};
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ * Timebase.cpp - Wrap-safe monotonic time on Timer5
+ * Part of ONI - Objeto Não Identificado
+ */
+
+#include "Arduino.h"
+#include "Timebase.h"
+#include "IrqAudit.h"
+
+static volatile uint32_t milliseconds;
+
+ISR(TIMER5_COMPA_vect)
+{
+    IRQ_AUDIT_ISR(IRQ_ISR_TIMEBASE, TCNT5 * TIMEBASE_PRESCALER); //the count started over at the match
+    milliseconds++;
+}
+
+//Reads the millisecond count and the ticks into it as one. A compare match that happened after
+//interrupts went off shows up as a set flag with a count that already started over
+static void read(uint32_t &ms, uint16_t &count)
+{
+    uint8_t sreg = SREG;
+    cli();
+    ms = milliseconds;
+    count = TCNT5;
+    if ((TIFR5 & (1 << OCF5A)) && count < TIMEBASE_TICKS_PER_MS / 2)
+    {
+        ms++;
+    }
+    SREG = sreg;
+}
+
+//Takes Timer5 over: CTC on OCR5A, one compare match per ms
+void Timebase::begin()
+{
+    uint8_t sreg = SREG;
+    cli();
+    TCCR5A = 0;
+    TCCR5B = 0;
+    TCNT5 = 0;
+    OCR5A = TIMEBASE_TICKS_PER_MS - 1;
+    TIFR5 = (1 << OCF5A); //written 1 clears it
+    TIMSK5 = (1 << OCIE5A);
+    TCCR5B = (1 << WGM52) | (1 << CS51); //CTC, prescaler 8
+    SREG = sreg;
+}
+
+//Milliseconds since begin()
+uint32_t Timebase::ms()
+{
+    uint32_t ms;
+    uint16_t count;
+    read(ms, count);
+    return ms;
+}
+
+//Microseconds since begin()
+uint32_t Timebase::now()
+{
+    uint32_t ms;
+    uint16_t count;
+    read(ms, count);
+    return ms * 1000 + count / TIMEBASE_TICKS_PER_US;
+}
+
+//Timer ticks since begin(), 1 / TIMEBASE_TICKS_PER_US us each. For profiling below a microsecond
+uint32_t Timebase::ticks()
+{
+    uint32_t ms;
+    uint16_t count;
+    read(ms, count);
+    return ms * TIMEBASE_TICKS_PER_MS + count;
+}
@@ -0,0 +1,45 @@
+/*
+ * Timebase.h - Wrap-safe monotonic time on Timer5
+ * Part of ONI - Objeto Não Identificado
+ *
+ * Timer5 counts 0.5 us ticks (prescaler 8 at 16 MHz) and clears every
+ * millisecond, when a short interrupt bumps a 32-bit millisecond count.
+ * ms(), now() (us) and ticks() are all built from that one count and the
+ * timer register, read with interrupts off, so they agree with each other
+ * and each one wraps cleanly at 2^32. Differences of two readings of the
+ * same unit are right across the wrap as long as they're under half of it:
+ * ~24 days in ms, ~35 min in us, ~17 min in ticks.
+ *
+ * Timer5 is no longer available for PWM on pins 44, 45 and 46. begin()
+ * must run in setup(): the core's init() sets Timer5 up for PWM.
+ */
+
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include "Arduino.h"
+
+#define TIMEBASE_PRESCALER 8
+#define TIMEBASE_TICKS_PER_MS (F_CPU / TIMEBASE_PRESCALER / 1000)
+#define TIMEBASE_TICKS_PER_US (TIMEBASE_TICKS_PER_MS / 1000)
+
+#if TIMEBASE_TICKS_PER_US * 1000 != TIMEBASE_TICKS_PER_MS
+#error "Timebase needs F_CPU to be a multiple of 8 MHz"
+#endif
+
+class Timebase
+{
+  public:
+    static void begin();
+    static uint32_t ms();
+    static uint32_t now();
+    static uint32_t ticks();
+
+    //Wrap-safe helpers. Deadlines are a reading plus an interval, in the same unit
+    static uint32_t elapsedMs(uint32_t since) { return ms() - since; }
+    static uint32_t elapsedUs(uint32_t since) { return now() - since; }
+    static bool reachedMs(uint32_t deadline) { return int32_t(ms() - deadline) >= 0; }
+    static bool reachedUs(uint32_t deadline) { return int32_t(now() - deadline) >= 0; }
+};
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * Watchdog.cpp - Hardware watchdog supervision with reset cause and breadcrumb
+ * Part of ONI - Objeto Não Identificado
+ */
+
+#include "Arduino.h"
+#include <avr/wdt.h>
+#include "Watchdog.h"
+
+//Kept across resets. .noinit isn't cleared by the startup code, so they hold garbage after a power-on
+static volatile uint8_t stage __attribute__ ((section (".noinit"))); //written while running
+static uint8_t resets __attribute__ ((section (".noinit"))); //watchdog resets in a row
+static uint8_t cause __attribute__ ((section (".noinit"))); //MCUSR at boot. .bss would be cleared after .init3
+static uint8_t previousStage __attribute__ ((section (".noinit")));
+
+//Saves and clears the reset cause, and stops the watchdog a watchdog reset leaves running with a 15 ms
+//timeout, long before setup() is done. Runs from .init3, before .data and .bss are set up
+void WatchdogInit(void) __attribute__ ((naked, used, section (".init3")));
+
+void WatchdogInit(void)
+{
+    cause = MCUSR;
+    MCUSR = 0;
+    wdt_disable();
+    previousStage = stage;
+    stage = WATCHDOG_NO_STAGE;
+    if (cause & (1 << WDRF))
+    {
+        resets++;
+    }
+    else
+    {
+        resets = 0;
+    }
+}
+
+//Starts the watchdog. timeout: one of the WDTO_* constants from avr/wdt.h
+void Watchdog::begin(uint8_t timeout)
+{
+    wdt_enable(timeout);
+}
+
+void Watchdog::feed()
+{
+    wdt_reset();
+}
+
+void Watchdog::stop()
+{
+    wdt_disable();
+}
+
+//Where the current stage goes, for the scheduler or the sketch to write
+volatile uint8_t *Watchdog::breadcrumb()
+{
+    return &stage;
+}
+
+//MCUSR at boot: PORF, EXTRF, BORF, WDRF and JTRF bits
+uint8_t Watchdog::resetCause()
+{
+    return cause;
+}
+
+//Stage running when the watchdog fired, WATCHDOG_NO_STAGE if it wasn't a watchdog reset or nothing was written
+uint8_t Watchdog::lastStage()
+{
+    return cause & (1 << WDRF) ? previousStage : WATCHDOG_NO_STAGE;
+}
+
+//Watchdog resets since the last reset of any other cause
+uint8_t Watchdog::watchdogResets()
+{
+    return resets;
+}
@@ -0,0 +1,37 @@
+/*
+ * Watchdog.h - Hardware watchdog supervision with reset cause and breadcrumb
+ * Part of ONI - Objeto Não Identificado
+ *
+ * The AVR watchdog resets the board when it isn't fed within its timeout.
+ * The sketch only feeds it after a whole control cycle ran within budget,
+ * so a hung driver, bus or serial write ends in a reset instead of the
+ * engines keeping their last command.
+ *
+ * MCUSR is copied and cleared from .init3, before anything else runs, and
+ * the watchdog is disabled there too: after a watchdog reset it is left
+ * running with its shortest timeout. The breadcrumb lives in .noinit, so
+ * the stage written before the reset is still there at boot. It's only
+ * meaningful when the reset cause has WDRF.
+ */
+
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include "Arduino.h"
+#include <avr/wdt.h> //WDTO_* timeouts
+
+#define WATCHDOG_NO_STAGE 0xFF
+
+class Watchdog
+{
+  public:
+    static void begin(uint8_t);
+    static void feed();
+    static void stop();
+    static volatile uint8_t *breadcrumb();
+    static uint8_t resetCause();
+    static uint8_t lastStage();
+    static uint8_t watchdogResets();
+};
+
+#endif
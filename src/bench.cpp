@@ -0,0 +1,185 @@
+/*
+	ONI - Objeto Não Identificado
+	Copyright 2015, 2017 Rodrigo Martins
+
+	This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//Control loop kernel benchmarks. Only built in env:bench, which runs them under simavr (see tools/bench.py)
+//Each kernel is timed with Timer1 counting CPU cycles and its stack use is measured by painting below the
+//stack pointer. Results go to Serial as "BENCH <name> <cycles> <stack bytes>" lines.
+#ifdef ONI_BENCH
+
+#include <Arduino.h>
+#include <avr/sleep.h>
+#include <PS2X_lib.h>
+#include <L293D.h>
+#include <DriveMixer.h>
+
+//Benchmark pins for the stubbed PS2 bus: nothing is connected, DAT reads the pull-up
+#define BENCH_CLK 22
+#define BENCH_CMD 23
+#define BENCH_ATT 24
+#define BENCH_DAT 25
+
+const byte STACK_CANARY = 0xA5;
+const unsigned int STACK_PROBE = 256; //how deep below the caller a kernel may go
+
+//From oni.cpp
+extern PS2X ps2x;
+extern L293D engL;
+void engineManager();
+void formatDebug();
+
+volatile unsigned int timerOverflows; //Timer1 overflows, every 65536 cycles
+unsigned long callOverhead; //cycles spent by measure() around an empty kernel
+unsigned int stackOverhead; //stack used by measure() around an empty kernel
+volatile int sink; //keeps results alive
+
+ISR(TIMER1_OVF_vect)
+{
+	timerOverflows++;
+}
+
+//Private PS2X access, see PS2X_BENCH
+class PS2XBench
+{
+	public:
+		static void attach(PS2X &pad)
+		{
+			pad._clk_mask = digitalPinToBitMask(BENCH_CLK);
+			pad._clk_oreg = portOutputRegister(digitalPinToPort(BENCH_CLK));
+			pad._cmd_mask = digitalPinToBitMask(BENCH_CMD);
+			pad._cmd_oreg = portOutputRegister(digitalPinToPort(BENCH_CMD));
+			pad._att_mask = digitalPinToBitMask(BENCH_ATT);
+			pad._att_oreg = portOutputRegister(digitalPinToPort(BENCH_ATT));
+			pad._dat_mask = digitalPinToBitMask(BENCH_DAT);
+			pad._dat_ireg = portInputRegister(digitalPinToPort(BENCH_DAT));
+			pinMode(BENCH_CLK, OUTPUT);
+			pinMode(BENCH_CMD, OUTPUT);
+			pinMode(BENCH_ATT, OUTPUT);
+			pinMode(BENCH_DAT, INPUT_PULLUP);
+		}
+		static void setSticks(PS2X &pad, byte lx, byte ry)
+		{
+			pad.PS2data[PSS_LX] = lx;
+			pad.PS2data[PSS_RY] = ry;
+		}
+		static void shiftInOut(PS2X &pad)
+		{
+			sink = pad._gamepad_shiftinout(0x42);
+		}
+};
+
+byte benchLX; //stick inputs for the next engineManager() run
+byte benchRY;
+
+void emptyKernel() {}
+void engineKernel() { PS2XBench::setSticks(ps2x, benchLX, benchRY); engineManager(); }
+void stickKernel() { sink = DriveMixer::stick(benchLX, false) + DriveMixer::stick(benchRY, true); }
+void formatDebugKernel() { formatDebug(); }
+void setForwardKernel() { engL.set(200); }
+void setReverseKernel() { engL.set(-200); }
+void setStopKernel() { engL.set(0); }
+void brakeKernel() { engL.brake(160); }
+void shiftInOutKernel() { PS2XBench::shiftInOut(ps2x); }
+
+//Runs a kernel once, returns the cycles it took and stores the stack bytes it used in stack
+unsigned long measure(void (*kernel)(), unsigned int &stack)
+{
+	Serial.flush(); //the last report's bytes go out now, not from USART0 interrupts inside the window and over the paint
+	volatile byte *sp = (volatile byte *)SP;
+	for (volatile byte *p = sp - STACK_PROBE; p < sp; p++)
+	{
+		*p = STACK_CANARY;
+	}
+
+	TCNT1 = 0;
+	timerOverflows = 0;
+	kernel();
+	unsigned int count = TCNT1;
+	unsigned long cycles = ((unsigned long)timerOverflows << 16) + count;
+	if ((TIFR1 & (1 << TOV1)) and count < 0x8000) //overflowed between the count and the ISR
+	{
+		cycles += 0x10000UL;
+	}
+
+	volatile byte *p = sp - STACK_PROBE;
+	while (p < sp and *p == STACK_CANARY)
+	{
+		p++;
+	}
+	stack = sp - p;
+	return cycles;
+}
+
+void report(const char *name, void (*kernel)())
+{
+	unsigned int stack;
+	unsigned long cycles = measure(kernel, stack);
+	Serial.print(F("BENCH "));
+	Serial.print(name);
+	Serial.print(' ');
+	Serial.print(cycles - callOverhead);
+	Serial.print(' ');
+	Serial.println(stack - stackOverhead);
+}
+
+void reportEngine(const char *name, byte lx, byte ry)
+{
+	benchLX = lx;
+	benchRY = ry;
+	report(name, engineKernel);
+}
+
+void setup()
+{
+	Serial.begin(115200);
+	PS2XBench::attach(ps2x);
+
+	//Timer1 counts CPU cycles. Timer0 (millis) is masked so its interrupt doesn't land inside a kernel
+	TIMSK0 = 0;
+	TCCR1A = 0;
+	TCCR1B = (1 << CS10);
+	TIMSK1 = (1 << TOIE1);
+
+	callOverhead = measure(emptyKernel, stackOverhead);
+
+	reportEngine("engineManager.center", 128, 128);
+	reportEngine("engineManager.forward", 128, 0);
+	reportEngine("engineManager.forward_right", 255, 0);
+	reportEngine("engineManager.reverse_left", 30, 220);
+	benchLX = 200;
+	benchRY = 40;
+	report("DriveMixer::stick", stickKernel);
+	report("formatDebug", formatDebugKernel);
+	report("L293D::set.forward", setForwardKernel);
+	report("L293D::set.reverse", setReverseKernel);
+	report("L293D::set.stop", setStopKernel);
+	report("L293D::brake", brakeKernel);
+	report("PS2X::_gamepad_shiftinout", shiftInOutKernel);
+
+	Serial.println(F("BENCH_DONE"));
+	Serial.flush();
+	cli(); //simavr quits when the CPU sleeps with interrupts off
+	set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+	sleep_enable();
+	sleep_cpu();
+}
+
+void loop()
+{
+}
+
+#endif
@@ -18,31 +18,124 @@
 
 #include <Arduino.h>
 #include <PS2X_lib.h> //for v1.6 **Modified**
+#include <PS2XBus.h> //several controllers on the same bus
+#include <PS2XInput.h> //the bus driver as an input source
+#include <SerialDrive.h> //drive commands from a host on USART1
 #include <L293D.h> // **Modified**
+#include <L293DThermal.h> //driver chip temperature and duty derating
 #include <EEPROM.h> //allows reading and writing from EEPROM
+#include <BatteryMonitor.h> //battery voltage on a free-running ADC
+#include <StackMonitor.h> //least free stack since boot
+#include <Scheduler.h> //multi-rate cooperative task scheduler
+#include <FlightRecorder.h> //ring of the last control cycles
+#include <Console.h> //serial command console
+#include <MotorCurve.h> //per engine speed to PWM linearization
+#include <AdcScanner.h> //free-running scan of the ADC channels
+#include <AutoCal.h> //stall PWM search on back-EMF
+#include <DriveMixer.h> //stick to engine speed mixing
+#include <LatencyProbe.h> //input to actuation latency
+#include <Watchdog.h> //hang supervision, reset cause and breadcrumb
+#include <Timebase.h> //wrap-safe ms and us on Timer5
+#include <IrqAudit.h> //interrupt latency audit, only with -D IRQ_AUDIT
 
 //PS2 controller pins
 #define PS2_DAT 14
 #define PS2_CMD 15
 #define PS2_SEL 16 //yellow
 #define PS2_CLK 17
+#define PS2_SEL_INSTRUCTOR 30 //second controller, shares the other pins
 
 // Hardware setup
 PS2X ps2x; //starts a 'PS2 controller' object
+PS2X ps2xInstructor; //instructor controller, takes over while holding L1 and L2
+PS2XBus controllers(PS2_CLK, PS2_CMD, PS2_DAT); //every controller on the bus
+PS2XInput ps2Input(controllers, ps2x); //controller driving this cycle, picked by controllers.arbitrate()
+
+//Host drive link: binary drive commands on USART1, RX1 is pin 19. See SerialDrive.h and tools/drive.py
+const unsigned long UART_BAUD = 250000; //exact at 16 MHz, a command every 0.36 ms at most
+const unsigned int UART_TIMEOUT = 150; //ms after its last byte a host command is stale, 3 control cycles
+SerialDrive uartInput;
+
+//Input selection, from the console
+const byte SOURCE_PS2 = 0; //the PS2 controllers
+const byte SOURCE_UART = 1; //the host on USART1
+unsigned int inputSource = SOURCE_PS2; //always PS2 at boot
+InputSource *input = &ps2Input; //where the sticks and buttons of this cycle come from
 
 //Starts a 'engine' object: enablePin, pinA, pinB. See L293D schematic for more details.
 L293D engL(11,2,3); //left engine
 L293D engR(12,7,8); //right engine
+L293DThermal driverChip; //both engines share one L293D: left is channel 0, right is channel 1. No current sense, currents are estimated from the duty
 
 const byte systemBuzzerPin = 9; //main buzzer
 
-//Debug control
-char buffer[128]; //this is the string that holds the debug output
-const boolean DEBUG_CLK_TIME = true; //weather should clock timings be written to serial: lastClockCycleTime
-const boolean DEBUG_MODE = true; //weather should the current mode be written to the serial: mode
-const boolean DEBUG_CONTROLLER = true; //weather should controller information be written to serial: validController LX RY
-const boolean DEGUB_CONTRLLER_TYPE = false; //weather should controller type be displayed on the console at a new reconnection: output from connection attempts
-const boolean DEBUG_ENGINE_MATH = true; //weather should engine math be displayed to the console: accel curve engineDeadzoneOffset calibrationBuffer curvatureSpeed*100 speedL speedR
+//Starts a 'battery' object: ADC channel, battery mV at ADC full scale. Battery goes to A0 through a 1:1 divider
+BatteryMonitor battery(0, 10000);
+
+//Debug control, every flag can be changed from the serial console
+char buffer[160]; //this is the string that holds the debug output
+boolean debugClockTime = true; //weather should clock timings be written to serial: longest frame busy time since the last line, in us
+boolean debugMode = true; //weather should the current mode be written to the serial: mode
+boolean debugController = true; //weather should controller information be written to serial: validController source LX RY. The source is the driving controller's number, or u for the host on USART1
+boolean debugControllerType = false; //weather should controller type be displayed on the console at a new reconnection: output from connection attempts
+boolean debugEngineMath = true; //weather should engine math be displayed to the console: accel curve calibrationChannel calibrationBuffer curvatureSpeed*100 speedL speedR
+boolean debugBattery = true; //weather should battery information be written to serial: batteryMillivolts charge outputLimit
+boolean debugThermal = true; //weather should the driver chip model be written to serial: chipTemperature dissipationMw maxDuty
+boolean debugMemory = true; //weather should the least free stack since boot be written to serial: stackMinFree
+boolean debugTasks = false; //weather should a second line with scheduler counters be written to serial: overruns and late/deferred/skipped for each task
+boolean debugLink = false; //weather should the driving controller link counters be written to serial: frames retries reconfigs noResponse badMode notAnalog badLength brownout detections longestInvalidStreak. From the host: frames badChecksum serialErrors dropped timeouts
+
+//Memory variables
+const unsigned int STACK_CHECK_INTERVAL = 1000; //how often should the stack be scanned. Costs a few cycles per free byte
+unsigned int stackMinFree; //least free stack since boot, in bytes
+unsigned long lastStackCheckTime; //stores when the stack was last scanned
+
+//Flight recorder variables
+const byte FLIGHT_RECORDER_DEPTH = 64; //how many control cycles are kept. 64 * 18 bytes of RAM
+const byte RECORD_VALID_CONTROLLER = 0x01; //flag bits
+const byte RECORD_FRAME_STATUS = 0x0E; //INPUT_* status of the cycle, shifted left by 1
+const byte RECORD_FAILSAFE = 0x10;
+const byte RECORD_OVERRUN = 0x20; //the frame before this cycle overran
+typedef struct
+{
+	unsigned int time; //Timebase::ms(), low 16 bits
+	byte lx; //raw left stick X
+	byte ry; //raw right stick Y
+	unsigned int buttons; //1 = pressed
+	byte mode;
+	int accel;
+	int curve;
+	int speedL;
+	int speedR;
+	unsigned int frameTime; //busy time of the frame before, in us
+	byte flags;
+} CycleRecord;
+FlightRecorder<CycleRecord, FLIGHT_RECORDER_DEPTH> recorder;
+const byte FAILSAFE_TRIP_FRAMES = 3; //invalid frames in a row before a failsafe trip freezes and dumps the recorder
+boolean failsafe; //engines are held stopped because the controller went invalid in DRIVE
+boolean dumping; //the recorder is being dumped
+boolean dumpHeader; //the header line of the dump is still to be written
+byte dumpCursor; //next record to dump
+
+//Latency variables
+const byte LATENCY_PINS[LATENCY_EVENTS] = {31, 33, 35, 37}; //marker pins toggled at poll start, frame received, mix done and output committed. LATENCY_NO_PIN for none
+LatencyProbe latency; //time from poll start to each event, every control cycle
+
+//Console variables
+const byte CONSOLE_BYTES_PER_CYCLE = 16; //most bytes taken from the serial buffer per console run
+const byte HELP_TUNABLES_PER_LINE = 4; //tunable names on each line of the help
+const byte TUNE_BOOLEAN = 0; //tunable types
+const byte TUNE_UINT = 1;
+const byte TUNE_HUNDREDTHS = 2; //float, read and written as an integer number of hundredths
+typedef struct
+{
+	const char *name; //in PROGMEM
+	byte type;
+	void *value;
+	long minimum;
+	long maximum;
+	void (*changed)(); //called after a write, may be NULL
+} Tunable;
 
 //Operational modes
 const byte WAIT	= 1; //default mode at startup
@@ -53,77 +146,346 @@ const byte CALIBRATION = 3; //engine dead zone calibration mode
 byte modusOperandi; //defines how the system should behave (i.e. current mode)
 boolean controllerEnabled; //enables controller
 boolean controllerMandatory; //if the mode only functions with a controller
-boolean clockEnabled; //enables the clock
-unsigned int definedClockTime; //how long should each clock cycle take
-
+unsigned int definedClockTime; //how long should each control cycle (controller polling and mode logic) take
+unsigned int controlPeriod = 50; //control cycle time used by every mode. Setting to 10 ms seemed to cause problems in controller connection
+unsigned int telemetryPeriod = 250; //how often is the debug line written
 
 //Clock variables
-unsigned int lastClockCycleTime; //stores the last clock cycle time
-unsigned int clockCycleStartTime; //stores when last clock cycle started
-boolean longExecutionTime; //holds true when loop takes longer than definedClockTime
+const unsigned int FRAME_TIME = 10; //scheduler frame length. Every task period is a multiple of it
+const unsigned int SPARE_INPUT_PERIOD = 50; //how often is a controller that isn't driving read
+
+//Watchdog variables
+const byte WATCHDOG_TIMEOUT = WDTO_1S; //longest hang before a reset. A controller detection plus an idle control cycle must fit
+const unsigned long CONTROL_CYCLE_BUDGET = 50000; //us from poll start to mode logic done. Longer cycles don't feed the watchdog
+unsigned long cycleStartTime; //Timebase::now() of the current control cycle poll
+
+//Idle variables
+const unsigned int IDLE_CONTROL_PERIOD = 200; //control cycle time while idle, also the longest wait before the first touch is seen
+const unsigned int IDLE_SPARE_INPUT_PERIOD = 1000; //spare controller reads while idle
+const unsigned int IDLE_TELEMETRY_PERIOD = 2000; //debug line period while idle
+const byte IDLE_STICK_NOISE = 4; //stick moves up to this many counts aren't activity
+unsigned int idleTimeout = 10000; //ms without a stick or button change in WAIT before going idle, 0 never
+boolean idle; //WAIT with nothing touched for idleTimeout: slower polling and telemetry
+unsigned long lastActivityTime; //stores when a stick or button last changed
+byte idleSticks[4]; //stick positions at the last activity: LX LY RX RY
+boolean idleValidController; //controller validity at the last activity
+
+//Buzzer variables
+typedef struct
+{
+	unsigned int frequency;
+	unsigned int duration; //how long the tone sounds
+	unsigned int next; //how long until the next note. 0 ends the melody after this note
+} Note;
+const Note *melody; //melody being played, in PROGMEM. NULL when quiet
+unsigned long nextNoteTime; //stores when the next note should sound
 
 //Controller variables
 const unsigned int CONTROLLER_TIMEOUT = 2000; //how long should be an error sequence before a controller detection
-unsigned int firstErrorTime = 1; //stores the beginning of an error sequence
-unsigned int lastErrorTime = 1; //stores the last error occurrence
+boolean errorSequence[PS2X_BUS_DEVICES]; //stores weather each controller is in an error sequence
+unsigned long firstErrorTime[PS2X_BUS_DEVICES]; //stores the beginning of the error sequence, for each controller
 boolean validController; //stores weather the controller is valid or not
 byte error; //stores error code for controller detection
 byte type; //stores controller type
 
+//Battery variables
+const unsigned int BATTERY_EMPTY = 6000; //mV considered 0% charge
+const unsigned int BATTERY_FULL = 8400; //mV considered 100% charge
+const unsigned int BATTERY_SAG = 6800; //below this many mV the engines output ceiling starts going down
+const unsigned int BATTERY_CUTOFF = 6000; //at this many mV the engines output ceiling reaches BATTERY_MIN_LIMIT
+const byte BATTERY_MIN_LIMIT = 96; //lowest engine output ceiling, keeps the robot limping home without browning out the logic rail
+const unsigned int BATTERY_WARNING_INTERVAL = 10000; //how often should the empty battery warning sound
+unsigned long lastBatteryWarningTime; //stores when the empty battery warning last sounded
+
 //Engine math variables
-const float TURN_RATE = 0.4; //this controls how sharp turning is, changes with velocity (0~1)
+float turnRate = 0.4; //this controls how sharp turning is, changes with velocity (0~1)
 const boolean INVERT_LEFT_STICK = false; //sets controller left stick inversion
 const boolean INVERT_RIGHT_STICK = true; //sets controller right stick inversion
-byte engineDeadzoneOffset = EEPROM.read(0); //read calibration data from persistent storage
 int accel;
 int curve;
-double curvatureSpeed;
-float pAccel;
-float pCurve;
+float curvatureSpeed;
 int speedL = 0; //speed on left engine
 int speedR = 0; //speed on right engine
 
+//Engine output variables
+const unsigned int REVERSAL_DEAD_TIME = 20; //ms an engine brakes before driving the other way
+const byte FAILSAFE_BRAKE = 255; //brake duty while the failsafe holds the engines stopped
+unsigned int releaseBrake = 160; //brake duty when the stick is released, 0 coasts
+
+//Settings variables
+const byte ENGINE_LEFT = 0;
+const byte ENGINE_RIGHT = 1;
+const int SETTINGS_ADDRESS = 1; //EEPROM address 0 holds the old single engineDeadzoneOffset, only read to migrate
+const byte SETTINGS_VERSION = 1;
+const byte EEPROM_ERASED = 0xFF; //what a byte that was never written reads
+typedef struct
+{
+	byte version;
+	MotorCurve curves[2]; //speed to PWM, for ENGINE_LEFT and ENGINE_RIGHT
+} Settings;
+Settings settings; //settings in use, loaded from EEPROM at boot
+
 //Calibration variables
-int calibrationBuffer = engineDeadzoneOffset; //this buffer stores calibration value while calibrating
+MotorCurve calibrationCurves[2]; //curves being calibrated, used when leaving calibration with R2 pressed
+byte calibrationChannel; //engine and direction being calibrated: engine * 2 + MOTOR_CURVE_FORWARD or MOTOR_CURVE_REVERSE
+int calibrationBuffer; //this buffer stores the stall PWM of the calibrated channel while calibrating
+const char CHANNEL_NAMES[4][3] = {"lf", "lr", "rf", "rr"}; //calibration channel names, engine * 2 + direction
+
+//Automatic calibration variables. Each engine's terminals reach its sense input through a diode OR and a 1:1 divider, so it reads back-EMF in either direction while coasting
+const byte SENSE_CHANNELS[2] = {1, 2}; //ADC channels of ENGINE_LEFT and ENGINE_RIGHT, A1 and A2
+const unsigned int AUTOCAL_THRESHOLD = 2600; //64 summed samples above this mean the wheel spins. About 0.4 V of back-EMF
+const unsigned int AUTOCAL_SETTLE_TIME = 150; //how long each trial PWM is driven, in ms
+const unsigned int AUTOCAL_BLANKING_TIME = 4; //how long to coast before sampling, lets the inductive kick die out
+const unsigned int AUTOCAL_REST_TIME = 300; //how long a wheel that moved is given to stop before the next trial
+int8_t senseSlots[2]; //AdcScanner slots of the sense inputs
+AutoCal autoCal[2]; //one search per engine, both run at the same time
+boolean autoCalibrating; //the automatic calibration is driving the engines
+byte autoCalDirection; //MOTOR_CURVE_FORWARD or MOTOR_CURVE_REVERSE, being searched on both engines
 
 //Necessary headers:
-void detectController();
 void setMode(byte);
 void controllerManager();
+void spareControllerManager();
+void pollController(byte);
+void detectController(byte);
 void modeManager();
 void keySequenceManager();
 void debugManager();
-void clockManager();
+void formatDebug();
+void reportReset();
 void waitMode();
+void idleManager();
+void setIdle(boolean);
 void calibrationMode();
 void driveMode();
 void engineManager();
+void batteryManager();
+void mixManager();
+void outputManager();
+void buzzerManager();
+void playMelody(const Note*);
+void loadSettings();
+boolean saveSettings();
+void recordCycle();
+void startDump();
+void dumpManager();
+void consoleManager();
+void applyClock();
+void applyTelemetryPeriod();
+void applyInputSource();
+const Tunable *findTunable(const char*);
+void formatTunable(const Tunable*, char*);
+void printTunable(const Tunable*);
+boolean helpLine(byte, char*);
+boolean getLine(byte, char*);
+boolean statsLine(byte, char*);
+boolean curveLine(byte, char*);
+boolean latencyLine(byte, char*);
+void helpCommand(byte, char**);
+void getCommand(byte, char**);
+void setCommand(byte, char**);
+void statsCommand(byte, char**);
+void snapCommand(byte, char**);
+void dumpCommand(byte, char**);
+void resetCommand(byte, char**);
+void curveCommand(byte, char**);
+void saveCommand(byte, char**);
+void latencyCommand(byte, char**);
+void autocalCommand(byte, char**);
+#ifdef IRQ_AUDIT
+boolean irqLine(byte, char*);
+void irqCommand(byte, char**);
+#endif
+void startAutoCalibration();
+void stopAutoCalibration();
+void autoCalibrationManager();
 boolean isValidController();
-int mapValues(byte, boolean);
 
+//Task table: run, period (ms), priority (lower runs first), budget (us), overrun policy
+const byte TASK_INPUT = 0;
+const byte TASK_MIX = 1;
+const byte TASK_OUTPUT = 2;
+const byte TASK_BUZZER = 3;
+const byte TASK_BATTERY = 4;
+const byte TASK_TELEMETRY = 5;
+const byte TASK_DUMP = 6;
+const byte TASK_CONSOLE = 7;
+const byte TASK_SPARE_INPUT = 8;
+Task tasks[] =
+{
+	{controllerManager, 50, 0, 4000, TASK_CRITICAL}, //poll input. Polling every 10 ms seemed to cause problems in controller connection
+	{mixManager, 50, 1, 1500, TASK_CRITICAL}, //mode logic and key sequences, right after the input they use
+	{outputManager, 10, 2, 500, TASK_CRITICAL}, //engines
+	{buzzerManager, 10, 3, 200, TASK_DEFER}, //melodies, a late note is better than a lost one
+	{batteryManager, 100, 4, 300, TASK_SKIP},
+	{debugManager, 250, 5, 3000, TASK_SKIP}, //telemetry, first to go when time is short
+	{dumpManager, 10, 6, 600, TASK_SKIP}, //flight recorder dump, one record at a time while the serial buffer has room
+	{consoleManager, 10, 7, 1500, TASK_SKIP}, //serial console, a few bytes per run
+	{spareControllerManager, SPARE_INPUT_PERIOD, 8, 2000, TASK_SKIP} //controllers that aren't driving, one per run so the control path reads a single one
+};
+Scheduler scheduler(tasks, sizeof(tasks) / sizeof(tasks[0]));
+
+//Serial console commands: name, handler, help
+const char HELP_NAME[] PROGMEM = "help";
+const char HELP_HELP[] PROGMEM = "lists commands and tunables";
+const char GET_NAME[] PROGMEM = "get";
+const char GET_HELP[] PROGMEM = "get [tunable] - reads one or every tunable";
+const char SET_NAME[] PROGMEM = "set";
+const char SET_HELP[] PROGMEM = "set <tunable> <value> - writes a tunable";
+const char STATS_NAME[] PROGMEM = "stats";
+const char STATS_HELP[] PROGMEM = "link, uart, task, frame, idle, stack, battery, thermal, console and reset counters";
+const char SNAP_NAME[] PROGMEM = "snap";
+const char SNAP_HELP[] PROGMEM = "writes a debug line now";
+const char DUMP_NAME[] PROGMEM = "dump";
+const char DUMP_HELP[] PROGMEM = "dumps the flight recorder";
+const char RESET_NAME[] PROGMEM = "reset";
+const char RESET_HELP[] PROGMEM = "clears link, uart, task and latency counters";
+const char CURVE_NAME[] PROGMEM = "curve";
+const char CURVE_HELP[] PROGMEM = "curve [lf|lr|rf|rr k0 k1 k2 k3 k4] - reads or writes engine curves";
+const char SAVE_NAME[] PROGMEM = "save";
+const char SAVE_HELP[] PROGMEM = "writes the settings to EEPROM";
+const char LATENCY_NAME[] PROGMEM = "latency";
+const char LATENCY_HELP[] PROGMEM = "latency [reset] - p50 p90 p99 max us from poll start to each event";
+const char AUTOCAL_NAME[] PROGMEM = "autocal";
+const char AUTOCAL_HELP[] PROGMEM = "searches every stall PWM, calibration mode only. Again to abort";
+#ifdef IRQ_AUDIT
+const char IRQ_NAME[] PROGMEM = "irq";
+const char IRQ_HELP[] PROGMEM = "irq [reset] - worst interrupt waits per code site and interrupt timings, in cycles";
+#endif
+const ConsoleCommand commands[] =
+{
+	{HELP_NAME, helpCommand, HELP_HELP},
+	{GET_NAME, getCommand, GET_HELP},
+	{SET_NAME, setCommand, SET_HELP},
+	{STATS_NAME, statsCommand, STATS_HELP},
+	{SNAP_NAME, snapCommand, SNAP_HELP},
+	{DUMP_NAME, dumpCommand, DUMP_HELP},
+	{RESET_NAME, resetCommand, RESET_HELP},
+	{CURVE_NAME, curveCommand, CURVE_HELP},
+	{SAVE_NAME, saveCommand, SAVE_HELP},
+	{LATENCY_NAME, latencyCommand, LATENCY_HELP},
+	{AUTOCAL_NAME, autocalCommand, AUTOCAL_HELP},
+#ifdef IRQ_AUDIT
+	{IRQ_NAME, irqCommand, IRQ_HELP}
+#endif
+};
+Console console(Serial, commands, sizeof(commands) / sizeof(commands[0]));
+
+//Serial console tunables: name, type, variable, minimum, maximum, called after a write
+const char TURN_NAME[] PROGMEM = "turn";
+const char CLOCK_NAME[] PROGMEM = "clock";
+const char TELEMETRY_NAME[] PROGMEM = "telemetry";
+const char BRAKE_NAME[] PROGMEM = "brake";
+const char IDLE_NAME[] PROGMEM = "idle";
+const char INPUT_NAME[] PROGMEM = "input";
+const char DEBUG_CLOCK_NAME[] PROGMEM = "debug.clock";
+const char DEBUG_MODE_NAME[] PROGMEM = "debug.mode";
+const char DEBUG_CONTROLLER_NAME[] PROGMEM = "debug.controller";
+const char DEBUG_TYPE_NAME[] PROGMEM = "debug.type";
+const char DEBUG_ENGINE_NAME[] PROGMEM = "debug.engine";
+const char DEBUG_BATTERY_NAME[] PROGMEM = "debug.battery";
+const char DEBUG_THERMAL_NAME[] PROGMEM = "debug.thermal";
+const char DEBUG_MEMORY_NAME[] PROGMEM = "debug.memory";
+const char DEBUG_TASKS_NAME[] PROGMEM = "debug.tasks";
+const char DEBUG_LINK_NAME[] PROGMEM = "debug.link";
+const Tunable tunables[] =
+{
+	{TURN_NAME, TUNE_HUNDREDTHS, &turnRate, 0, 100, NULL},
+	{CLOCK_NAME, TUNE_UINT, &controlPeriod, FRAME_TIME, 500, applyClock}, //the watchdog is only fed once per control cycle
+	{TELEMETRY_NAME, TUNE_UINT, &telemetryPeriod, FRAME_TIME, 60000, applyTelemetryPeriod},
+	{BRAKE_NAME, TUNE_UINT, &releaseBrake, 0, 255, NULL},
+	{IDLE_NAME, TUNE_UINT, &idleTimeout, 0, 60000, NULL},
+	{INPUT_NAME, TUNE_UINT, &inputSource, SOURCE_PS2, SOURCE_UART, applyInputSource}, //0 PS2 controllers, 1 host on USART1
+	{DEBUG_CLOCK_NAME, TUNE_BOOLEAN, &debugClockTime, 0, 1, NULL},
+	{DEBUG_MODE_NAME, TUNE_BOOLEAN, &debugMode, 0, 1, NULL},
+	{DEBUG_CONTROLLER_NAME, TUNE_BOOLEAN, &debugController, 0, 1, NULL},
+	{DEBUG_TYPE_NAME, TUNE_BOOLEAN, &debugControllerType, 0, 1, NULL},
+	{DEBUG_ENGINE_NAME, TUNE_BOOLEAN, &debugEngineMath, 0, 1, NULL},
+	{DEBUG_BATTERY_NAME, TUNE_BOOLEAN, &debugBattery, 0, 1, NULL},
+	{DEBUG_THERMAL_NAME, TUNE_BOOLEAN, &debugThermal, 0, 1, NULL},
+	{DEBUG_MEMORY_NAME, TUNE_BOOLEAN, &debugMemory, 0, 1, NULL},
+	{DEBUG_TASKS_NAME, TUNE_BOOLEAN, &debugTasks, 0, 1, NULL},
+	{DEBUG_LINK_NAME, TUNE_BOOLEAN, &debugLink, 0, 1, NULL}
+};
+
+//Melodies: frequency, duration, time until next note
+const Note EEPROM_WRITE_MELODY[] PROGMEM = {{880, 200, 200}, {1046, 1000, 0}};
+const Note DRIVE_MELODY[] PROGMEM = {{2800, 50, 100}, {2800, 250, 250}, {2000, 50, 50}, {2200, 50, 50}, {1500, 50, 50}, {3000, 50, 0}};
+const Note DRIVE_NEW_CALIBRATION_MELODY[] PROGMEM = {{2800, 30, 100}, {2800, 50, 100}, {2800, 250, 250}, {2000, 50, 50}, {2200, 50, 50}, {1500, 50, 50}, {3000, 50, 0}}; //modified so it states the change
+const Note CALIBRATION_MELODY[] PROGMEM = {{500, 30, 29}, {580, 30, 29}, {660, 30, 29}, {740, 30, 29}, {820, 30, 29}, {900, 30, 29}, {980, 30, 29}, {1060, 30, 29}, {1140, 30, 29}, {1220, 30, 29}, {1300, 30, 29}, {1380, 30, 29}, {1460, 30, 29}, {1540, 30, 29}, {1620, 30, 29}, {1700, 30, 29}, {1780, 30, 0}}; //little noise for debugging
 
+#ifndef ONI_BENCH //the benchmark build (src/bench.cpp) brings its own setup() and loop()
 void setup()
 {
+	Timebase::begin(); //before anything keeps time
+#ifdef IRQ_AUDIT
+	IrqAudit::begin(); //Timer4 becomes the probe
+#endif
+	engL.coast(); //engines off whatever brought us here
+	engR.coast();
 	pinMode(systemBuzzerPin, OUTPUT); //main buzzer
+	engL.setDeadTime(REVERSAL_DEAD_TIME, 255); //reversals brake hard through the dead time
+	engR.setDeadTime(REVERSAL_DEAD_TIME, 255);
 	Serial.begin(115200);
+	reportReset();
+	uartInput.setTimeout(UART_TIMEOUT);
+	uartInput.begin(UART_BAUD); //listens whatever the input source, so its counters show the link before switching
 
-	detectController(); //initialize controller
+	battery.setCharge(BATTERY_EMPTY, BATTERY_FULL);
+	battery.setLimit(BATTERY_SAG, BATTERY_CUTOFF, BATTERY_MIN_LIMIT);
+	battery.begin(); //the ADC runs on its own from now on, analogRead() must not be used
+	senseSlots[ENGINE_LEFT] = AdcScanner::add(SENSE_CHANNELS[ENGINE_LEFT]); //only sampled while something takes the blocks
+	senseSlots[ENGINE_RIGHT] = AdcScanner::add(SENSE_CHANNELS[ENGINE_RIGHT]);
+	for (byte engine = ENGINE_LEFT; engine <= ENGINE_RIGHT; engine++)
+	{
+		autoCal[engine].setTiming(AUTOCAL_SETTLE_TIME, AUTOCAL_BLANKING_TIME, AUTOCAL_REST_TIME);
+		autoCal[engine].setThreshold(AUTOCAL_THRESHOLD);
+	}
+
+	loadSettings(); //engine curves
+
+	for (byte event = 0; event < LATENCY_EVENTS; event++)
+	{
+		latency.setPin(event, LATENCY_PINS[event]);
+	}
+
+	controllers.add(ps2x, PS2_SEL, 1, 0); //drives whenever the instructor doesn't claim
+	controllers.add(ps2xInstructor, PS2_SEL_INSTRUCTOR, 0, PSB_L1 | PSB_L2);
+	controllers.begin(); //deselect every controller before talking to any
+	for (byte i = 0; i < controllers.count(); i++)
+	{
+		controllers.pad(i).enableBrownoutDetect(true); //reject well formed frames carrying low voltage patterns
+		detectController(i); //initialize controller
+	}
 	setMode(WAIT); //sets mode to wait at boot
+	scheduler.setBreadcrumb(Watchdog::breadcrumb()); //the running task survives a watchdog reset
+	Watchdog::begin(WATCHDOG_TIMEOUT); //from now on a control cycle must complete every WATCHDOG_TIMEOUT
+	scheduler.begin(FRAME_TIME); //release every task now
 }
 
 void loop()
 {
-	clockCycleStartTime = millis(); //clock cycle start
+	scheduler.runFrame(); //runs the due tasks in priority order, deferring or skipping low priority ones when the frame is short
 
-	controllerManager(); //controller validation manager
+	scheduler.waitFrame(); //waits for the next frame
+}
+#endif
 
+//Control logic, runs right after the controller is polled
+void mixManager()
+{
+	IRQ_AUDIT_SITE(IRQ_SITE_CONTROL);
 	modeManager(); //call the right mode function for the current mode
+	latency.mark(LATENCY_MIX_DONE, Timebase::now());
 
 	keySequenceManager(); //detects key sequences and combinations and changes between modes
 
-	debugManager(); //prints debug information
+	recordCycle(); //keep this cycle in the flight recorder
 
-	clockManager(); //clock manager
+	if (Timebase::elapsedUs(cycleStartTime) <= CONTROL_CYCLE_BUDGET) //a whole control cycle in budget, the loop is alive
+	{
+		Watchdog::feed();
+	}
 }
 
 //Calls the current mode manager
@@ -145,10 +507,88 @@ void modeManager()
 	}
 }
 
+//Tells why the board reset, and which task was running if it was the watchdog
+void reportReset()
+{
+	byte cause = Watchdog::resetCause();
+	Serial.print(F("Reset:"));
+	if (cause & (1 << PORF))
+	{
+		Serial.print(F(" power-on"));
+	}
+	if (cause & (1 << EXTRF))
+	{
+		Serial.print(F(" external"));
+	}
+	if (cause & (1 << BORF))
+	{
+		Serial.print(F(" brown-out"));
+	}
+	if (cause & (1 << JTRF))
+	{
+		Serial.print(F(" JTAG"));
+	}
+	if (cause & (1 << WDRF))
+	{
+		sprintf(buffer, " watchdog in task %u, %u in a row", Watchdog::lastStage(), Watchdog::watchdogResets()); //SCHEDULER_WAITING (254) is between frames
+		Serial.print(buffer);
+		tone(systemBuzzerPin, 540, 1000); //sound warning buzzer
+	}
+	if (cause == 0)
+	{
+		Serial.print(F(" unknown")); //the bootloader cleared MCUSR
+	}
+	Serial.println();
+}
+
 //Wait mode operation
 void waitMode() //what happens in wait mode?
 {
-	;
+	idleManager(); //nothing to drive, save some battery while nobody touches the controller
+}
+
+//Drops to the idle rates after idleTimeout without a stick or button change, and back on the first one
+void idleManager()
+{
+	boolean active = validController != idleValidController; //plugging or losing a controller counts
+	if (validController)
+	{
+		active = active or input->newButtonState();
+		for (byte i = INPUT_LX; i <= INPUT_RY; i++)
+		{
+			if (abs(input->analog(i) - idleSticks[i]) > IDLE_STICK_NOISE)
+			{
+				active = true;
+			}
+		}
+	}
+
+	if (active)
+	{
+		for (byte i = INPUT_LX; i <= INPUT_RY; i++)
+		{
+			idleSticks[i] = validController ? input->analog(i) : 128;
+		}
+		idleValidController = validController;
+		lastActivityTime = Timebase::ms();
+		setIdle(false);
+	}
+	else if (idleTimeout != 0 and Timebase::elapsedMs(lastActivityTime) > idleTimeout)
+	{
+		setIdle(true);
+	}
+}
+
+//Switches the input and telemetry tasks between the full and the idle rates
+void setIdle(boolean newIdle)
+{
+	if (newIdle != idle)
+	{
+		idle = newIdle;
+		applyClock(); //setPeriod() pulls the next releases in when going back to full rate
+		applyTelemetryPeriod();
+		scheduler.setPeriod(TASK_SPARE_INPUT, idle ? IDLE_SPARE_INPUT_PERIOD : SPARE_INPUT_PERIOD);
+	}
 }
 
 //Drive mode operation
@@ -157,45 +597,78 @@ void driveMode() //what happens in drive mode?
 	if (validController)
 	{
 		engineManager();
+		failsafe = false;
 	}
 	else
 	{
-
+		speedL = 0; //failsafe: never keep driving on the last command
+		speedR = 0;
+		if (not failsafe and input->invalidStreak() >= FAILSAFE_TRIP_FRAMES) //trip, keep what led here
+		{
+			failsafe = true;
+			recordCycle(); //the tripping cycle goes in before the recorder freezes
+			startDump();
+		}
 	}
 }
 
 //Calibration mode operation
 void calibrationMode() //what happens in calibration mode?
 {
+	if (autoCalibrating) //outputManager() drives the engines until it's done
+	{
+		if (not validController or input->buttonPressed(PSB_CIRCLE)) //lost controller or circle pressed, abort
+		{
+			stopAutoCalibration();
+		}
+		return;
+	}
 	if (validController)
 	{
-		if (ps2x.Button(PSB_CROSS)) //if cross is pressed, test calibration value on the engines.
+		byte engine = calibrationChannel >> 1;
+		byte direction = calibrationChannel & 1;
+		if (input->button(PSB_CROSS)) //if cross is pressed, test calibration value on the calibrated engine and direction
 		{
-			engL.set(calibrationBuffer);
-			engL.set(calibrationBuffer);
+			int pwm = direction == MOTOR_CURVE_FORWARD ? calibrationBuffer : -calibrationBuffer;
+			engL.set(engine == ENGINE_LEFT ? pwm : 0);
+			engR.set(engine == ENGINE_RIGHT ? pwm : 0);
 		}
 		else
 		{
 			engL.set(0); //stop engines if PSB_CROSS is no longer pressed
-			engL.set(0);
+			engR.set(0);
 		}
 
-		if (ps2x.ButtonPressed(PSB_CIRCLE)) //if circle was pressed, reset calibration buffer to 0
+		if (input->buttonPressed(PSB_PAD_LEFT) or input->buttonPressed(PSB_PAD_RIGHT)) //select the previous or next engine and direction
+		{
+			if (calibrationBuffer != calibrationCurves[engine].stall(direction)) //keep what was set for this one
+			{
+				calibrationCurves[engine].setStall(direction, calibrationBuffer);
+			}
+			calibrationChannel = (calibrationChannel + (input->buttonPressed(PSB_PAD_RIGHT) ? 1 : 3)) & 3;
+			calibrationBuffer = calibrationCurves[calibrationChannel >> 1].stall(calibrationChannel & 1);
+			tone(systemBuzzerPin, 1000 + 250 * calibrationChannel, 50); //higher pitch for higher channels
+		}
+		else if (input->buttonPressed(PSB_TRIANGLE)) //if triangle was pressed, find every stall PWM automatically. Wheels must be free
+		{
+			startAutoCalibration();
+		}
+		else if (input->buttonPressed(PSB_CIRCLE)) //if circle was pressed, reset calibration buffer to 0
 		{
 			calibrationBuffer = 0;
 		}
-		else if (ps2x.ButtonPressed(PSB_SQUARE)) //if square was pressed, reset calibration buffer current value
+		else if (input->buttonPressed(PSB_SQUARE)) //if square was pressed, reset calibration buffer current value
 		{
-			calibrationBuffer = engineDeadzoneOffset;
+			calibrationBuffer = settings.curves[engine].stall(direction);
 		}
-		else if (ps2x.ButtonPressed(PSB_PAD_UP) or ps2x.ButtonPressed(PSB_PAD_DOWN)) //up or down arrow was pressed, increase or decrease calibration buffer
+		else if (input->buttonPressed(PSB_PAD_UP) or input->buttonPressed(PSB_PAD_DOWN)) //up or down arrow was pressed, increase or decrease calibration buffer
 		{
 			byte addToBuffer = 0; //stores how much will be added to the buffer
-			if (ps2x.Button(PSB_L1)) //L1 is pressed, increase by a greater amount
+			if (input->button(PSB_L1)) //L1 is pressed, increase by a greater amount
 			{
 				addToBuffer += 15;
 			}
-			else if (ps2x.Button(PSB_L2)) //L2 is pressed, increase by a lesser amount
+			else if (input->button(PSB_L2)) //L2 is pressed, increase by a lesser amount
 			{
 				addToBuffer += 1;
 			}
@@ -204,7 +677,7 @@ void calibrationMode() //what happens in calibration mode?
 				addToBuffer += 5;
 			}
 
-			if (ps2x.ButtonPressed(PSB_PAD_UP)) //if arrow up was pressed, increase buffer
+			if (input->buttonPressed(PSB_PAD_UP)) //if arrow up was pressed, increase buffer
 			{
 				calibrationBuffer += addToBuffer;
 			}
@@ -221,63 +694,68 @@ void calibrationMode() //what happens in calibration mode?
 	}
 }
 
-//Allows modes to operate in fixed clock
-void clockManager()
+//Sets control cycle time: how often is the controller polled and the mode logic run
+void setClock(int clockTime)
+{
+	definedClockTime = clockTime;
+	scheduler.setPeriod(TASK_INPUT, clockTime);
+	scheduler.setPeriod(TASK_MIX, clockTime);
+}
+
+//Checks if the controller is properly connected
+void controllerManager()
 {
-	//This next function should always be the last one in the loop sequence
-	if (clockEnabled) //if current mode uses clock
+	cycleStartTime = Timebase::now();
+	if (controllerEnabled) //if current mode uses controller
 	{
-		lastClockCycleTime = millis() - clockCycleStartTime; //processing time used in the main loop
-		if (lastClockCycleTime > definedClockTime) //if loop used processing time is greater than the defined clock time
+		if (input == &uartInput)
 		{
-			longExecutionTime = true; //report long execution
+			if (uartInput.read()) //a new command, its latency counts from its last byte
+			{
+				latency.mark(LATENCY_POLL_START, uartInput.arrival());
+			}
 		}
-		else //if lastClockCycleTime was faster than definedClockTime...
+		else
 		{
-			delay(definedClockTime - lastClockCycleTime); //...we still got some time to waste
+			latency.mark(LATENCY_POLL_START, cycleStartTime);
+			pollController(controllers.driver()); //only the driver is read here, the others take turns in spareControllerManager()
+			ps2Input.read(); //the highest priority controller claiming control drives
 		}
+		latency.mark(LATENCY_FRAME_RX, Timebase::now());
+		isValidController(); //check the input the mode logic is about to use
 	}
 }
 
-//Sets clock time
-void setClock(int clockTime)
+//Reads one controller that isn't driving, so it's ready to take over
+void spareControllerManager()
 {
-	if (clockTime == 0)
+	if (controllerEnabled and input == &ps2Input)
 	{
-		clockEnabled = false;
-		definedClockTime = 0;
-	}
-	else
-	{
-		clockEnabled = true;
-		definedClockTime = clockTime;
+		controllers.next();
 	}
 }
 
-//Checks if the controller is properly connected
-void controllerManager()
+//Reads a controller, detecting it again after a long sequence of bad frames
+void pollController(byte index)
 {
-	if (controllerEnabled) //if current mode uses controller
+	controllers.read(index); //read controller
+	if (controllers.pad(index).frameStatus() == PS2X_FRAME_OK) //if valid controller
+	{
+		errorSequence[index] = false; //mark controller as valid this cycle
+	}
+	else //invalid readings
 	{
-		ps2x.read_gamepad(); //read controller
-		if (isValidController()) //if valid controller
+		if (not errorSequence[index]) //if controller was valid on last cycle
 		{
-			firstErrorTime = 1; //mark controller as valid this cycle
+			errorSequence[index] = true;
+			firstErrorTime[index] = Timebase::ms(); //store first error occurrence
 		}
-		else //invalid readings
+		else //if controller was not valid last cycle
 		{
-			lastErrorTime = millis(); //store last error occurrence
-			if (firstErrorTime == 1) //if controller was valid on last cycle
+			if (Timebase::elapsedMs(firstErrorTime[index]) > CONTROLLER_TIMEOUT) //if invalid readings for more than the timeout
 			{
-				firstErrorTime = lastErrorTime; //store first error occurrence
-			}
-			else //if controller was not valid last cycle
-			{
-				if ((lastErrorTime - firstErrorTime) > CONTROLLER_TIMEOUT) //if invalid readings for more than the timeout
-				{
-					detectController(); //controller must be unconnected, detectController()
-					firstErrorTime = 1; //wait one more timeout before next check
-				}
+				detectController(index); //controller must be unconnected, detectController()
+				errorSequence[index] = false; //wait one more timeout before next check
 			}
 		}
 	}
@@ -286,37 +764,38 @@ void controllerManager()
 //Check data integrity
 boolean isValidController ()
 {
-	if ((ps2x.Analog(PSS_LY) == 255 and ps2x.Analog(PSS_RX) == 255) or (ps2x.Analog(PSS_LY) == 0 and ps2x.Analog(PSS_RX) == 0))
-	{
-		validController = false;
-		return false; //controller readings are all 255 or 0. Might be poorly connected or not connected at all
-	}
-	else if (ps2x.Analog(PSS_LY) == 115 and ps2x.Analog(PSS_RX) == 115)
-	{
-		tone(systemBuzzerPin, 540, 1000); //sound warning buzzer
-		validController = false;
-		return false; //controller readings are all 115. This usually happens when high logic voltage level falls down. Low battery
-	}
-	else
+	//PS2X checks every frame for the 0x5A ready byte, an analog mode byte and a matching length, so legitimate
+	//full deflection sticks (0 or 255) are no longer mistaken for a disconnected controller. Host commands carry a crc
+	switch (input->status())
 	{
-		validController = true;
-		return true;
+		case INPUT_OK:
+			validController = true;
+			return true;
+
+		case INPUT_BROWNOUT:
+			tone(systemBuzzerPin, 540, 1000); //sound warning buzzer
+			validController = false;
+			return false; //all buttons pressed or sticks all on 115. This usually happens when high logic voltage level falls down. Low battery
+			//acting on these frames would make the system switch between forward and backwards each cycle or behave strangely
+
+		default:
+			validController = false;
+			return false; //no ready byte, wrong mode or wrong length, or a stale host command. Might be poorly connected or not connected at all
 	}
-	//corner case: sometimes when high logic voltage goes really low, all buttons can go to 1 when analogs aren't 0 or 255
-	//could  be detected by checking one or more buttons (e.g. PSB_START). When such happens, the system might sometimes
-	// switch between forward and backwards each cycle or behave strangely, similarly to when analogs are on 115
 }
 
 //Library controller detection function
-void detectController()
+void detectController(byte index)
 {
 	//Setup pins and settings: GamePad(clock, command, attention, data, Pressures?, Rumble?) check for error
-	error = ps2x.config_gamepad(PS2_CLK, PS2_CMD, PS2_SEL, PS2_DAT, false, false);
-	type = ps2x.readType();
+	error = controllers.detect(index);
+	type = controllers.pad(index).readType();
 
 	//Serial prints for controller information
-	if (DEGUB_CONTRLLER_TYPE)
+	if (debugControllerType)
 	{
+		Serial.print(F("Controller "));
+		Serial.println(index);
 		switch(error) //prints out controller state
 		{
 			case 0:
@@ -357,23 +836,24 @@ void keySequenceManager()
 {
 	if (validController) //if controller i present
 	{
-		if (ps2x.ButtonPressed(PSB_R3)) //if R3 was just pressed
+		if (input->buttonPressed(PSB_START) and input->button(PSB_SELECT)) //start pressed while holding select
+		{
+			startDump(); //dump the flight recorder
+		}
+		if (input->buttonPressed(PSB_R3)) //if R3 was just pressed
 		{
-			if (ps2x.Button(PSB_PAD_RIGHT) and ps2x.Button(PSB_SELECT)) //if right and select were pressed
+			if (input->button(PSB_PAD_RIGHT) and input->button(PSB_SELECT)) //if right and select were pressed
 			{
 				setMode(CALIBRATION); //initialize calibration mode
 			}
 			else //if right and select were not pressed
 			{
-				if (ps2x.Button(PSB_R2) and ps2x.Button(PSB_R1) and modusOperandi == DRIVE) //if on DRIVE mode and L1 and L2 are pressed
+				if (input->button(PSB_R2) and input->button(PSB_R1) and modusOperandi == DRIVE) //if on DRIVE mode and L1 and L2 are pressed
 				{
-					if (EEPROM.read(0) != engineDeadzoneOffset) //and current calibration data is different from stored on EEPROM
+					if (saveSettings()) //and current calibration data is different from stored on EEPROM
 					{
-						EEPROM.update(0, engineDeadzoneOffset); //update EEPROM with new calibration value (EEPROM <3)
 						Serial.println("Writing calibration to EEPROM"); //write new data to EEPROM
-						tone(systemBuzzerPin, 880.00, 200);
-						delay(200);
-						tone(systemBuzzerPin, 1046.50, 1000);
+						playMelody(EEPROM_WRITE_MELODY);
 					}
 					else
 					{
@@ -391,55 +871,50 @@ void setMode(byte newMode)
 {
 	if (newMode != modusOperandi) //if newMode is different from current mode
 	{
+		setIdle(false); //every mode starts at full rate
+		lastActivityTime = Timebase::ms();
 		switch(newMode)
 		{
 			case WAIT:
+				stopAutoCalibration();
 				modusOperandi = WAIT;
 				controllerEnabled = true; //enable controller
-				setClock(50); //set clock to 50m
+				setClock(controlPeriod);
 				break;
 
 			case DRIVE:
+				stopAutoCalibration();
 				modusOperandi = DRIVE;
 				controllerEnabled = true;
-				setClock(50); //50ms clock time. Setting to 10 ms seemed to cause problems in controller connection
-				if (ps2x.Button(PSB_R2)) //entered drive mode with R2 pressed
+				setClock(controlPeriod);
+				playMelody(DRIVE_MELODY);
+				if (input->button(PSB_R2)) //entered drive mode with R2 pressed
 				{
-					if (calibrationBuffer != engineDeadzoneOffset) //the old calibration data is different from new
+					if (calibrationBuffer != calibrationCurves[calibrationChannel >> 1].stall(calibrationChannel & 1)) //keep the last channel edited
+					{
+						calibrationCurves[calibrationChannel >> 1].setStall(calibrationChannel & 1, calibrationBuffer);
+					}
+					if (memcmp(calibrationCurves, settings.curves, sizeof(settings.curves)) != 0) //the old calibration data is different from new
 					{
 						Serial.println("Using new calibration value");
-						engineDeadzoneOffset = calibrationBuffer; //use new calibration data
-						tone(systemBuzzerPin, 2800, 30); //modify the sound so it states the change
-						delay(100);
+						memcpy(settings.curves, calibrationCurves, sizeof(settings.curves)); //use new calibration data
+						playMelody(DRIVE_NEW_CALIBRATION_MELODY);
 					}
 					else
 					{
 						Serial.println("No new calibration data!");
 					}
 				}
-				tone(systemBuzzerPin, 2800, 50);
-				delay(100);
-				tone(systemBuzzerPin, 2800, 250);
-				delay(250);
-				tone(systemBuzzerPin, 2000, 50);
-				delay(50);
-				tone(systemBuzzerPin, 2200, 50);
-				delay(50);
-				tone(systemBuzzerPin, 1500, 50);
-				delay(50);
-				tone(systemBuzzerPin, 3000, 50);
 				break;
 
 			case CALIBRATION:
 				modusOperandi = CALIBRATION;
 				controllerEnabled = true;
-				setClock(50);
-				calibrationBuffer = engineDeadzoneOffset; //set calibration buffer to current calibration value
-				for (int i=500;i<1800;i+=80) //make little noise for debugging
-					{
-						tone(systemBuzzerPin, i, 30);
-						delay(29);
-					}
+				setClock(controlPeriod);
+				memcpy(calibrationCurves, settings.curves, sizeof(settings.curves)); //start from the curves in use
+				calibrationChannel = 0; //left engine, forward
+				calibrationBuffer = calibrationCurves[ENGINE_LEFT].stall(MOTOR_CURVE_FORWARD); //set calibration buffer to current calibration value
+				playMelody(CALIBRATION_MELODY);
 				break;
 		}
 	}
@@ -447,107 +922,708 @@ void setMode(byte newMode)
 
 //Shows debug information relating the most relevant system parameters
 void debugManager ()
+{
+	IRQ_AUDIT_SITE(IRQ_SITE_TELEMETRY);
+	if (dumping or console.replying())
+	{
+		return; //keep the dump and console reply lines together
+	}
+	formatDebug(); //fill the buffer
+	Serial.println(buffer); //print the debug string
+
+	if (debugTasks)
+	{
+		sprintf(buffer, "T %u", scheduler.overruns());
+		for (byte i = 0; i < sizeof(tasks) / sizeof(tasks[0]); i++)
+		{
+			sprintf(buffer, "%s  %u %u %u", buffer, tasks[i].late, tasks[i].deferred, tasks[i].skipped);
+		}
+		Serial.println(buffer);
+	}
+}
+
+//Formats the debug line into the buffer
+void formatDebug()
 {
 	buffer[0] = '\0'; //clear the buffer by setting the first char as null
-	if (DEBUG_CLK_TIME)
+	if (debugClockTime)
 	{
-		sprintf(buffer, "%3u ", lastClockCycleTime); //format the output string
+		sprintf(buffer, "%5u ", scheduler.worstFrameTime()); //format the output string
+		scheduler.resetWorstFrameTime();
 	}
-	if (DEBUG_MODE)
+	if (debugMode)
 	{
 		sprintf(buffer, "%s %u ", buffer, modusOperandi);
 	}
-	if (DEBUG_CONTROLLER)
+	if (debugController)
 	{
-		sprintf(buffer, "%s %i %03u %03u ", buffer, validController, ps2x.Analog(PSS_LX), ps2x.Analog(PSS_RY)); //append to the buffer
+		sprintf(buffer, "%s %i %c %03u %03u ", buffer, validController, input == &uartInput ? 'u' : '0' + controllers.driver(), input->analog(INPUT_LX), input->analog(INPUT_RY)); //append to the buffer
 	}
-	if (DEBUG_ENGINE_MATH)
+	if (debugEngineMath)
 	{
-		sprintf(buffer, "%s %+04i %+04i %+04i %+04i %+04i %+04i %+04i ", buffer, accel, curve, engineDeadzoneOffset, calibrationBuffer, int(curvatureSpeed*100), speedL, speedR);
+		sprintf(buffer, "%s %+04i %+04i %+04i %+04i %+04i %+04i %+04i ", buffer, accel, curve, calibrationChannel, calibrationBuffer, int(curvatureSpeed*100), speedL, speedR);
+	}
+	if (debugBattery)
+	{
+		sprintf(buffer, "%s %4u %3u %3u ", buffer, battery.millivolts(), battery.charge(), battery.outputLimit());
+	}
+	if (debugThermal)
+	{
+		sprintf(buffer, "%s %3u %4u %3u ", buffer, driverChip.temperature(), driverChip.dissipation(), driverChip.maxDuty());
+	}
+	if (debugMemory)
+	{
+		if (Timebase::elapsedMs(lastStackCheckTime) > STACK_CHECK_INTERVAL)
+		{
+			lastStackCheckTime = Timebase::ms();
+			stackMinFree = StackMonitor::minFree();
+		}
+		sprintf(buffer, "%s %4u ", buffer, stackMinFree);
+	}
+	if (debugLink)
+	{
+		if (input == &uartInput)
+		{
+			SerialDriveStats link = uartInput.stats();
+			sprintf(buffer, "%s %lu %u %u %u %u ", buffer, link.frames, link.badChecksum, link.serialErrors, link.dropped, link.timeouts);
+		}
+		else
+		{
+			const PS2X_Stats &link = ps2Input.pad().stats();
+			sprintf(buffer, "%s %lu %u %u %u %u %u %u %u %u %u ", buffer, link.frames, link.retries, link.reconfigs, link.invalid[PS2X_FRAME_NO_RESPONSE], link.invalid[PS2X_FRAME_BAD_MODE], link.invalid[PS2X_FRAME_NOT_ANALOG], link.invalid[PS2X_FRAME_BAD_LENGTH], link.invalid[PS2X_FRAME_BROWNOUT], link.detections, link.longestInvalidStreak);
+		}
 	}
-	Serial.println(buffer); //print the debug string
 }
 
-void engineManager()
+//Packs this control cycle into the flight recorder. No formatting, just copies
+void recordCycle()
 {
-	curve = mapValues(ps2x.Analog(PSS_LX), INVERT_LEFT_STICK); //curves -> horizontal axis, left stick
-	accel = mapValues(ps2x.Analog(PSS_RY), INVERT_RIGHT_STICK); //acceleration -> vertical axis, right stick
-
-	//Set speed according to accel readings. Set curvatureSpeed to 0 in case of no curves
-	speedL = accel;
-	speedR = accel;
+	CycleRecord &record = recorder.add();
+	record.time = Timebase::ms();
+	record.lx = input->analog(INPUT_LX);
+	record.ry = input->analog(INPUT_RY);
+	record.buttons = input->buttons();
+	record.mode = modusOperandi;
+	record.accel = accel;
+	record.curve = curve;
+	record.speedL = speedL;
+	record.speedR = speedR;
+	record.frameTime = scheduler.frameTime();
+	record.flags = (validController ? RECORD_VALID_CONTROLLER : 0) | (input->status() << 1) | (failsafe ? RECORD_FAILSAFE : 0) | (scheduler.frameTime() > FRAME_TIME * 1000U ? RECORD_OVERRUN : 0);
+}
 
-	curvatureSpeed = 0;
-	int curvatureToSpeed = 0; //could use a byte?
-	int curvatureToSpeedReversed = 0; //could use a byte?
-	pAccel = float(accel)/255; //divide by maximum possible value to get a percentage number
-	pCurve = float(curve)/255; //1 = 100%, 0.5 = 50%
-	 //might be able to optimize speed by not using this percentage in the engine math
+//Freezes the flight recorder and starts dumping it from the oldest record
+void startDump()
+{
+	if (not dumping)
+	{
+		recorder.freeze();
+		dumping = true;
+		dumpHeader = true; //written by dumpManager(), this may be in the middle of a console reply
+		dumpCursor = 0;
+	}
+}
 
-	//Calculate curvatureSpeed only if there is accel and curve
-	if (curve != 0 and accel != 0)
+//Dumps one flight recorder record per run, only when it fits in the serial buffer without blocking
+void dumpManager()
+{
+	IRQ_AUDIT_SITE(IRQ_SITE_CONSOLE);
+	if (not dumping or console.replying() or Serial.availableForWrite() < 63)
+	{
+		return;
+	}
+	if (dumpHeader)
+	{
+		Serial.println(F("R index time lx ry buttons mode accel curve speedL speedR frameTime flags"));
+		dumpHeader = false;
+	}
+	else if (dumpCursor < recorder.count())
 	{
-		curvatureSpeed = float(map(int(((1 - pow(fabsf(pAccel),fabsf(pCurve))) + float(map(TURN_RATE*fabsf(pCurve)*100 - TURN_RATE*fabsf(pAccel)*50,-TURN_RATE*50,TURN_RATE*100,0,TURN_RATE*100))/100)*100),0,100 + TURN_RATE*100,0,100))/100; //really complicated stuff. There's a picture attached to the source code explaining this.
-		curvatureToSpeed = map(curvatureSpeed*100,0,100,accel,-accel); //when curvatureSpeed is 0, no curves. When 50, one wheel stops. When 100, this wheel spins at the same speed that the accel, but reverse.
-		//probably should not convert into percentages then out
-		curvatureToSpeedReversed = -map(curvatureSpeed*100,0,100,-accel,accel); //when curvatureSpeed is 0, no curves. When -50, one wheel stops. When -100, this wheel spins at the same speed that the accel, but reverse.
+		const CycleRecord &record = recorder.at(dumpCursor);
+		sprintf(buffer, "R %u %u %u %u %04X %u %i %i %i %i %u %02X", dumpCursor, record.time, record.lx, record.ry, record.buttons, record.mode, record.accel, record.curve, record.speedL, record.speedR, record.frameTime, record.flags);
+		Serial.println(buffer);
+		dumpCursor++;
 	}
-	//Setting speeds
-	//For accel > 0 and accel < 0 speedR and speedL get set to the same values, just reversed. It might be possible to remove these statements by incorporating these cases to the main formula
-	if (accel > 0) //going forward
+	else
 	{
-		//For turning
-		if (curve > 0) //going right
+		Serial.println(F("R end"));
+		dumping = false;
+		recorder.unfreeze();
+	}
+}
+
+//Runs the serial console within its byte budget
+void consoleManager()
+{
+	IRQ_AUDIT_SITE(IRQ_SITE_CONSOLE);
+	console.poll(CONSOLE_BYTES_PER_CYCLE);
+}
+
+//Applies a new control cycle time from the console
+void applyClock()
+{
+	setClock(idle ? max(controlPeriod, IDLE_CONTROL_PERIOD) : controlPeriod);
+}
+
+//Applies a new debug line period from the console
+void applyTelemetryPeriod()
+{
+	scheduler.setPeriod(TASK_TELEMETRY, idle ? max(telemetryPeriod, IDLE_TELEMETRY_PERIOD) : telemetryPeriod);
+}
+
+//Switches the input source from the console. Driving stops until the new source has a valid input
+void applyInputSource()
+{
+	input = inputSource == SOURCE_UART ? (InputSource*)&uartInput : (InputSource*)&ps2Input;
+}
+
+//Finds a tunable by name, NULL if there's none
+const Tunable *findTunable(const char *name)
+{
+	for (byte i = 0; i < sizeof(tunables) / sizeof(tunables[0]); i++)
+	{
+		if (strcmp_P(name, tunables[i].name) == 0)
 		{
-			speedR = curvatureToSpeed;
+			return &tunables[i];
 		}
-		else if (curve < 0) //going left
+	}
+	return NULL;
+}
+
+//Puts "name value" for a tunable in line
+void formatTunable(const Tunable *tunable, char *line)
+{
+	long value;
+	switch (tunable->type)
+	{
+		case TUNE_BOOLEAN:
+			value = *(boolean*)tunable->value;
+			break;
+		case TUNE_UINT:
+			value = *(unsigned int*)tunable->value;
+			break;
+		default: //TUNE_HUNDREDTHS
+			value = lround(*(float*)tunable->value * 100);
+			break;
+	}
+	strcpy_P(line, tunable->name);
+	sprintf(line, "%s %ld", line, value);
+}
+
+//Writes "name value" for a tunable
+void printTunable(const Tunable *tunable)
+{
+	formatTunable(tunable, buffer);
+	Serial.println(buffer);
+}
+
+//Console reply lines of help: the commands, then the tunables a few to a line
+boolean helpLine(byte n, char *line)
+{
+	if (console.helpLine(n, line))
+	{
+		return true;
+	}
+	byte first = (n - sizeof(commands) / sizeof(commands[0])) * HELP_TUNABLES_PER_LINE;
+	if (first >= sizeof(tunables) / sizeof(tunables[0]))
+	{
+		return false;
+	}
+	strcpy_P(line, PSTR("tunables:"));
+	for (byte i = first; i < first + HELP_TUNABLES_PER_LINE and i < sizeof(tunables) / sizeof(tunables[0]); i++)
+	{
+		strcat(line, " ");
+		strcat_P(line, tunables[i].name);
+	}
+	return true;
+}
+
+//Console reply lines of get without a name: every tunable
+boolean getLine(byte n, char *line)
+{
+	if (n >= sizeof(tunables) / sizeof(tunables[0]))
+	{
+		return false;
+	}
+	formatTunable(&tunables[n], line);
+	return true;
+}
+
+void helpCommand(byte argc, char *argv[])
+{
+	console.reply(helpLine);
+}
+
+void getCommand(byte argc, char *argv[])
+{
+	if (argc < 2) //no name, every tunable
+	{
+		console.reply(getLine);
+		return;
+	}
+	const Tunable *tunable = findTunable(argv[1]);
+	if (tunable == NULL)
+	{
+		Serial.println(F("no such tunable"));
+		return;
+	}
+	printTunable(tunable);
+}
+
+void setCommand(byte argc, char *argv[])
+{
+	if (argc < 3)
+	{
+		Serial.println(F("usage: set <tunable> <value>"));
+		return;
+	}
+	const Tunable *tunable = findTunable(argv[1]);
+	if (tunable == NULL)
+	{
+		Serial.println(F("no such tunable"));
+		return;
+	}
+	char *end;
+	long value = strtol(argv[2], &end, 10);
+	if (*end != '\0' or value < tunable->minimum or value > tunable->maximum)
+	{
+		Serial.print(F("out of range "));
+		Serial.print(tunable->minimum);
+		Serial.print('~');
+		Serial.println(tunable->maximum);
+		return;
+	}
+	switch (tunable->type)
+	{
+		case TUNE_BOOLEAN:
+			*(boolean*)tunable->value = value;
+			break;
+		case TUNE_UINT:
+			*(unsigned int*)tunable->value = value;
+			break;
+		default: //TUNE_HUNDREDTHS
+			*(float*)tunable->value = value / 100.0;
+			break;
+	}
+	if (tunable->changed != NULL)
+	{
+		tunable->changed();
+	}
+	printTunable(tunable);
+}
+
+//Console reply lines of stats: link, uart, task, frame, idle, stack, battery, thermal, console and reset counters
+boolean statsLine(byte n, char *line)
+{
+	if (n < controllers.count()) //frames retries reconfigs timeoutReconfigs noResponse badMode notAnalog badLength brownout detections longestInvalidStreak ageOfLastGoodFrame
+	{
+		const PS2X_Stats &link = controllers.pad(n).stats();
+		sprintf(line, "link %u %lu %u %u %u %u %u %u %u %u %u %u %lu", n, link.frames, link.retries, link.reconfigs, link.timeoutReconfigs, link.invalid[PS2X_FRAME_NO_RESPONSE], link.invalid[PS2X_FRAME_BAD_MODE], link.invalid[PS2X_FRAME_NOT_ANALOG], link.invalid[PS2X_FRAME_BAD_LENGTH], link.invalid[PS2X_FRAME_BROWNOUT], link.detections, link.longestInvalidStreak, controllers.age(n));
+		return true;
+	}
+	n -= controllers.count();
+	if (n == 0) //frames badChecksum serialErrors dropped timeouts msSinceLastCommand
+	{
+		SerialDriveStats uart = uartInput.stats();
+		sprintf(line, "uart %lu %u %u %u %u %lu", uart.frames, uart.badChecksum, uart.serialErrors, uart.dropped, uart.timeouts, Timebase::elapsedUs(uartInput.arrival()) / 1000);
+		return true;
+	}
+	n -= 1;
+	if (n < sizeof(tasks) / sizeof(tasks[0])) //runs late deferred skipped overBudget worst
+	{
+		sprintf(line, "task %u %u %u %u %u %u %u", n, tasks[n].runs, tasks[n].late, tasks[n].deferred, tasks[n].skipped, tasks[n].overBudget, tasks[n].worst);
+		return true;
+	}
+	switch (n - sizeof(tasks) / sizeof(tasks[0]))
+	{
+		case 0:
+			sprintf(line, "frame %u %u %u", scheduler.overruns(), scheduler.worstFrameTime(), scheduler.wakeLatency()); //overruns worstBusyTime worstWakeLatency
+			return true;
+		case 1:
+			sprintf(line, "idle %u %lu", idle, Timebase::elapsedMs(lastActivityTime) / 1000); //idle secondsSinceActivity
+			return true;
+		case 2:
+			sprintf(line, "stack %u", StackMonitor::minFree());
+			return true;
+		case 3:
+			sprintf(line, "battery %u %u %u", battery.millivolts(), battery.charge(), battery.outputLimit());
+			return true;
+		case 4:
+			sprintf(line, "thermal %u %u %u %u %u", driverChip.temperature(), driverChip.dissipation(), driverChip.maxDuty(), driverChip.current(ENGINE_LEFT), driverChip.current(ENGINE_RIGHT));
+			return true;
+		case 5:
+			sprintf(line, "console %u %u", console.lines(), console.errors());
+			return true;
+		case 6:
+			sprintf(line, "reset %u %u %u", Watchdog::resetCause(), Watchdog::lastStage(), Watchdog::watchdogResets()); //MCUSR task watchdogResetsInARow
+			return true;
+	}
+	return false;
+}
+
+void statsCommand(byte argc, char *argv[])
+{
+	console.reply(statsLine);
+}
+
+void snapCommand(byte argc, char *argv[])
+{
+	formatDebug();
+	Serial.println(buffer);
+}
+
+void dumpCommand(byte argc, char *argv[])
+{
+	startDump();
+}
+
+void resetCommand(byte argc, char *argv[])
+{
+	for (byte i = 0; i < controllers.count(); i++)
+	{
+		controllers.pad(i).resetStats();
+	}
+	uartInput.resetStats();
+	scheduler.resetStats();
+	latency.reset();
+	Serial.println(F("counters cleared"));
+}
+
+//Loads the settings from EEPROM. Without valid settings, builds straight engine curves from the old single offset
+void loadSettings()
+{
+	EEPROM.get(SETTINGS_ADDRESS, settings);
+	if (settings.version != SETTINGS_VERSION or not settings.curves[ENGINE_LEFT].valid() or not settings.curves[ENGINE_RIGHT].valid())
+	{
+		byte engineDeadzoneOffset = EEPROM.read(0); //shared by both engines and directions
+		if (engineDeadzoneOffset == EEPROM_ERASED)
 		{
-			speedL = curvatureToSpeed;
+			engineDeadzoneOffset = 0; //never written: a blank or erased board has no offset, and a 255 stall would drive any touch at full power
 		}
+		settings.version = SETTINGS_VERSION;
+		settings.curves[ENGINE_LEFT].setLinear(engineDeadzoneOffset, engineDeadzoneOffset);
+		settings.curves[ENGINE_RIGHT].setLinear(engineDeadzoneOffset, engineDeadzoneOffset);
 	}
-	else if (accel < 0) //going reverse
+	memcpy(calibrationCurves, settings.curves, sizeof(settings.curves)); //nothing calibrated yet
+	calibrationBuffer = calibrationCurves[ENGINE_LEFT].stall(MOTOR_CURVE_FORWARD);
+}
+
+//Writes the settings to EEPROM. Returns false when they were already there
+boolean saveSettings()
+{
+	Settings stored;
+	EEPROM.get(SETTINGS_ADDRESS, stored);
+	if (memcmp(&stored, &settings, sizeof(settings)) == 0)
+	{
+		return false;
+	}
+	EEPROM.put(SETTINGS_ADDRESS, settings); //only changed bytes are written (EEPROM <3)
+	return true;
+}
+
+//Console reply lines of curve without a channel: every curve
+boolean curveLine(byte channel, char *line)
+{
+	if (channel >= 4)
+	{
+		return false;
+	}
+	const byte *knots = settings.curves[channel >> 1].knots[channel & 1];
+	sprintf(line, "curve %s %u %u %u %u %u", CHANNEL_NAMES[channel], knots[0], knots[1], knots[2], knots[3], knots[4]);
+	return true;
+}
+
+void curveCommand(byte argc, char *argv[])
+{
+	if (argc == 1) //no channel, show every curve
 	{
-		//For turning
-		if (curve > 0) //going right
+		console.reply(curveLine);
+		return;
+	}
+	byte channel = 0;
+	while (channel < 4 and strcmp(argv[1], CHANNEL_NAMES[channel]) != 0)
+	{
+		channel++;
+	}
+	if (channel == 4 or argc != 2 + MOTOR_CURVE_POINTS)
+	{
+		Serial.println(F("usage: curve lf|lr|rf|rr k0 k1 k2 k3 k4"));
+		return;
+	}
+	MotorCurve edited = settings.curves[channel >> 1];
+	for (byte i = 0; i < MOTOR_CURVE_POINTS; i++)
+	{
+		edited.knots[channel & 1][i] = constrain(atoi(argv[2 + i]), 0, 255);
+	}
+	if (not edited.valid())
+	{
+		Serial.println(F("knots must not go down"));
+		return;
+	}
+	settings.curves[channel >> 1] = edited;
+	Serial.println(F("ok, save to keep it"));
+}
+
+void saveCommand(byte argc, char *argv[])
+{
+	Serial.println(saveSettings() ? F("settings written") : F("no new data to write"));
+}
+
+//Console reply lines of latency: percentiles of each event, then the cycle count
+boolean latencyLine(byte n, char *line)
+{
+	byte event = LATENCY_FRAME_RX + n;
+	if (event < LATENCY_EVENTS)
+	{
+		latency.format(event, line);
+		return true;
+	}
+	if (event == LATENCY_EVENTS)
+	{
+		sprintf(line, "latency cycles %u sampling 0~%lu", latency.cycles(), definedClockTime * 1000UL); //a stick move waits up to a control cycle to be polled
+		return true;
+	}
+	return false;
+}
+
+void latencyCommand(byte argc, char *argv[])
+{
+	if (argc > 1 and strcmp(argv[1], "reset") == 0)
+	{
+		latency.reset();
+		Serial.println(F("latency cleared"));
+		return;
+	}
+	console.reply(latencyLine);
+}
+
+#ifdef IRQ_AUDIT
+//Console reply lines of irq: the totals, then each code site and each interrupt
+boolean irqLine(byte n, char *line)
+{
+	unsigned int floorWait = IrqAudit::floor(); //entry cost, a wait above it had interrupts off
+	if (n == 0)
+	{
+		sprintf(line, "irq probes %lu late %u floor %u worst at ", IrqAudit::probes(), IrqAudit::late(), floorWait);
+		strcat_P(line, IrqAudit::siteName(IrqAudit::worstSite()));
+		return true;
+	}
+	n -= 1;
+	if (n < IRQ_AUDIT_SITES) //probes worstWait window
+	{
+		IrqAuditSiteStats stats = IrqAudit::site(n);
+		strcpy_P(line, PSTR("irq site "));
+		strcat_P(line, IrqAudit::siteName(n));
+		sprintf(line, "%s %lu %u %u", line, stats.probes, stats.worst, stats.probes == 0 ? 0 : stats.worst - floorWait);
+		return true;
+	}
+	n -= IRQ_AUDIT_SITES;
+	if (n < IRQ_AUDIT_ISRS) //runs worstDuration worstEntry worstBlock
+	{
+		IrqAuditIsrStats stats = IrqAudit::isr(n);
+		strcpy_P(line, PSTR("irq isr "));
+		strcat_P(line, IrqAudit::isrName(n));
+		sprintf(line, "%s %lu %u %u %u", line, stats.runs, stats.worstDuration, stats.worstEntry, stats.worstBlock);
+		return true;
+	}
+	return false;
+}
+
+void irqCommand(byte argc, char *argv[])
+{
+	if (argc > 1 and strcmp(argv[1], "reset") == 0)
+	{
+		IrqAudit::reset();
+		Serial.println(F("irq cleared"));
+		return;
+	}
+	console.reply(irqLine);
+}
+#endif
+
+//Plays a melody in the background, replacing whatever was playing
+void playMelody(const Note *newMelody)
+{
+	melody = newMelody;
+	nextNoteTime = Timebase::ms();
+}
+
+//Sounds the next note of the current melody when it's due
+void buzzerManager()
+{
+	IRQ_AUDIT_SITE(IRQ_SITE_BUZZER);
+	if (melody != NULL and Timebase::reachedMs(nextNoteTime))
+	{
+		Note note;
+		memcpy_P(&note, melody, sizeof(note)); //melodies live in flash
+		tone(systemBuzzerPin, note.frequency, note.duration);
+		nextNoteTime += note.next;
+		melody = note.next == 0 ? NULL : melody + 1;
+	}
+}
+
+//Keeps the battery reading filtered and warns when it's empty
+void batteryManager()
+{
+	battery.update(); //fold the latest ADC block into the filter
+	if (battery.charge() == 0 and Timebase::elapsedMs(lastBatteryWarningTime) > BATTERY_WARNING_INTERVAL)
+	{
+		lastBatteryWarningTime = Timebase::ms();
+		tone(systemBuzzerPin, 540, 200); //same pitch as the controller low voltage warning, but short
+	}
+}
+
+void engineManager()
+{
+	curve = DriveMixer::stick(input->analog(INPUT_LX), INVERT_LEFT_STICK); //curves -> horizontal axis, left stick
+	accel = DriveMixer::stick(input->analog(INPUT_RY), INVERT_RIGHT_STICK); //acceleration -> vertical axis, right stick
+
+	curvatureSpeed = DriveMixer::mix(accel, curve, turnRate, speedL, speedR); //there's a picture attached to the source code explaining this
+	digitalWrite(systemBuzzerPin, input->button(PSB_R3)); //control buzzer based on R3 state
+}
+
+//Drives the engines with the speeds from engineManager(). Runs faster than the control cycle
+void outputManager()
+{
+	IRQ_AUDIT_SITE(IRQ_SITE_OUTPUT);
+	if (modusOperandi == DRIVE)
+	{
+		//Linearize each engine through its curve, then hold the PWM under the battery and driver chip output ceilings
+		int outputLimit = min(battery.outputLimit(), driverChip.maxDuty());
+		int pwmR = constrain(settings.curves[ENGINE_RIGHT].apply(speedR), -outputLimit, outputLimit);
+		int pwmL = constrain(settings.curves[ENGINE_LEFT].apply(speedL), -outputLimit, outputLimit);
+		byte brakeDuty = failsafe ? FAILSAFE_BRAKE : releaseBrake; //a stopped engine brakes, hardest on a failsafe stop
+		if (speedR == 0) //a released stick brakes. Decided before the curve, so a speed the curve or the ceilings bring down to PWM 0 coasts
+		{
+			engR.brake(brakeDuty);
+		}
+		else
+		{
+			engR.set(pwmR);
+		}
+		if (speedL == 0)
 		{
-			speedR = curvatureToSpeedReversed;
+			engL.brake(brakeDuty);
 		}
-		else if (curve < 0) //going left
+		else
 		{
-			speedL = curvatureToSpeedReversed;
+			engL.set(pwmL);
 		}
+		latency.mark(LATENCY_OUTPUT_COMMIT, Timebase::now());
+	}
+	else if (modusOperandi == CALIBRATION and autoCalibrating)
+	{
+		autoCalibrationManager();
 	}
-	engR.set(speedR);
-	engL.set(speedL);
-	digitalWrite(systemBuzzerPin, ps2x.Button(PSB_R3)); //control buzzer based on R3 state
+	driverChip.setBrake(ENGINE_LEFT, engL.braking()); //braking and reversing heat the chip too
+	driverChip.setBrake(ENGINE_RIGHT, engR.braking());
+	driverChip.update(engL.output(), engR.output(), Timebase::ms()); //whatever drove the engines, calibration included, heats the chip
 }
 
-int mapValues(byte value, boolean invert)
+//Starts searching the forward stall PWM of both engines, then the reverse one
+void startAutoCalibration()
 {
-	//This function should get the values from the analog axis and convert to PWM values for engine power control
-	if (value == 128) //if analogs are in the middle position
+	autoCalibrating = true;
+	autoCalDirection = MOTOR_CURVE_FORWARD;
+	autoCal[ENGINE_LEFT].start(Timebase::ms(), 0, 255);
+	autoCal[ENGINE_RIGHT].start(Timebase::ms(), 0, 255);
+	Serial.println(F("Automatic calibration started"));
+}
+
+//Aborts the automatic calibration, keeping whatever it already stored
+void stopAutoCalibration()
+{
+	if (autoCalibrating)
 	{
-		return 0; //no movement
+		autoCalibrating = false;
+		autoCal[ENGINE_LEFT].abort();
+		autoCal[ENGINE_RIGHT].abort();
+		engL.set(0);
+		engR.set(0);
+		Serial.println(F("Automatic calibration aborted"));
 	}
-	else
+}
+
+//Steps both searches: drives the trial PWMs and feeds them back-EMF readings taken while coasting
+void autoCalibrationManager()
+{
+	boolean busy = false;
+	for (byte engine = ENGINE_LEFT; engine <= ENGINE_RIGHT; engine++)
+	{
+		byte previous = autoCal[engine].state();
+		byte state = autoCal[engine].step(Timebase::ms());
+		if (state == AUTOCAL_SAMPLE)
+		{
+			uint16_t block;
+			if (previous != AUTOCAL_SAMPLE)
+			{
+				AdcScanner::drop(senseSlots[engine]); //the reading must start after the blanking time
+			}
+			else if (AdcScanner::take(senseSlots[engine], block))
+			{
+				autoCal[engine].sense(block);
+			}
+		}
+		int pwm = autoCal[engine].duty();
+		pwm = autoCalDirection == MOTOR_CURVE_FORWARD ? pwm : -pwm;
+		(engine == ENGINE_LEFT ? engL : engR).set(pwm);
+		busy = busy or autoCal[engine].busy();
+	}
+	if (busy)
+	{
+		return;
+	}
+
+	//Both engines are done with this direction
+	for (byte engine = ENGINE_LEFT; engine <= ENGINE_RIGHT; engine++)
 	{
-		if (invert)
+		byte channel = engine * 2 + autoCalDirection;
+		if (autoCal[engine].state() == AUTOCAL_DONE)
 		{
-			return int(-value*2 + 128*2 - 1); //maps value to range from 0~255 to 255~(-255), inverted
+			calibrationCurves[engine].setStall(autoCalDirection, autoCal[engine].result());
+			sprintf(buffer, "autocal %s %u %u", CHANNEL_NAMES[channel], autoCal[engine].result(), autoCal[engine].probes());
 		}
 		else
 		{
-			return int(+value*2 - 128*2 + 1); //maps value to range from 0~255 to -255~255
+			sprintf(buffer, "autocal %s failed, kept %u", CHANNEL_NAMES[channel], calibrationCurves[engine].stall(autoCalDirection));
 		}
+		Serial.println(buffer);
+	}
+	if (autoCalDirection == MOTOR_CURVE_FORWARD)
+	{
+		autoCalDirection = MOTOR_CURVE_REVERSE;
+		autoCal[ENGINE_LEFT].start(Timebase::ms(), 0, 255);
+		autoCal[ENGINE_RIGHT].start(Timebase::ms(), 0, 255);
+		return;
+	}
+
+	//Every channel searched: use and keep the results
+	autoCalibrating = false;
+	calibrationBuffer = calibrationCurves[calibrationChannel >> 1].stall(calibrationChannel & 1);
+	memcpy(settings.curves, calibrationCurves, sizeof(settings.curves));
+	if (saveSettings())
+	{
+		Serial.println("Writing calibration to EEPROM");
+		playMelody(EEPROM_WRITE_MELODY);
+	}
+	else
+	{
+		Serial.println("No new data to write!");
 	}
 }
 
-/*
-//map() function:
-long map(long x, long in_min, long in_max, long out_min, long out_max)
+void autocalCommand(byte argc, char *argv[])
 {
-  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+	if (autoCalibrating)
+	{
+		stopAutoCalibration();
+	}
+	else if (modusOperandi != CALIBRATION)
+	{
+		Serial.println(F("enter calibration mode first"));
+	}
+	else
+	{
+		startAutoCalibration();
+	}
 }
-
-*/
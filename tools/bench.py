@@ -0,0 +1,114 @@
+# ONI - Objeto Não Identificado
+# PlatformIO extra script for env:bench: runs the kernel benchmarks under simavr
+#
+#   pio run -e bench -t bench
+#
+# builds src/bench.cpp (ONI_BENCH), runs it on a simulated ATmega2560 and
+# writes bench_results.json to the project directory with, per kernel, the
+# exact CPU cycles, the stack bytes it used and the flash taken by its
+# function. Firmware totals are included so a review diff shows both hot
+# path cycle counts and size regressions.
+
+import json
+import re
+import subprocess
+
+Import("env")
+
+ANSI = re.compile(r"\x1b\[[0-9;]*m")
+BENCH_LINE = re.compile(r"BENCH (\S+) (\d+) (\d+)")
+
+# kernel name (before the first dot) -> function whose flash size is reported
+KERNEL_SYMBOLS = {
+    "engineManager": "engineManager()",
+    "DriveMixer::stick": "DriveMixer::stick(",
+    "formatDebug": "formatDebug()",
+    "L293D::set": "L293D::set(",
+    "L293D::brake": "L293D::brake(",
+    "PS2X::_gamepad_shiftinout": "PS2X::_gamepad_shiftinout(",
+}
+
+
+def option(name, default):
+    try:
+        return env.GetProjectOption(name)
+    except Exception:
+        return default
+
+
+def tool(name):
+    return env.subst("$CC").replace("gcc", name)
+
+
+def symbol_sizes(elf):
+    sizes = {}
+    out = subprocess.check_output([tool("nm"), "--print-size", "--radix=d", "-C", elf]).decode()
+    for line in out.splitlines():
+        fields = line.split(None, 3)
+        if len(fields) == 4 and fields[2].lower() == "t":
+            sizes[fields[3]] = int(fields[1])
+    return sizes
+
+
+def firmware_sizes(elf):
+    sizes = {}
+    out = subprocess.check_output([tool("size"), "-A", "-d", elf]).decode()
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) >= 2 and fields[0].startswith(".") and fields[1].isdigit():
+            sizes[fields[0]] = int(fields[1])
+    return {
+        "flash_bytes": sizes.get(".text", 0) + sizes.get(".data", 0),
+        "ram_bytes": sizes.get(".data", 0) + sizes.get(".bss", 0) + sizes.get(".noinit", 0),
+    }
+
+
+def run_bench(target, source, env):
+    elf = source[0].get_abspath()
+    simavr = option("custom_simavr", "simavr")
+    command = [simavr, "-m", "atmega2560", "-f", "16000000", elf]
+    try:
+        out = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                             timeout=int(option("custom_bench_timeout", "60"))).stdout.decode(errors="replace")
+    except subprocess.TimeoutExpired:
+        print("simavr timed out before BENCH_DONE")
+        return 1
+
+    out = ANSI.sub("", out)
+    if "BENCH_DONE" not in out:
+        print(out)
+        print("Benchmark did not finish")
+        return 1
+
+    functions = symbol_sizes(elf)
+    kernels = {}
+    for name, cycles, stack in BENCH_LINE.findall(out):
+        prefix = KERNEL_SYMBOLS.get(name.split(".")[0])
+        flash = [size for symbol, size in functions.items() if prefix and symbol.startswith(prefix)]
+        kernels[name] = {
+            "cycles": int(cycles),
+            "stack_bytes": int(stack),
+            "flash_bytes": flash[0] if flash else None,
+        }
+
+    results = {"cpu_hz": 16000000, "firmware": firmware_sizes(elf), "kernels": kernels}
+    path = env.subst("$PROJECT_DIR/bench_results.json")
+    with open(path, "w") as f:
+        json.dump(results, f, indent=2, sort_keys=True)
+        f.write("\n")
+
+    print("%-32s %9s %6s %6s" % ("kernel", "cycles", "stack", "flash"))
+    for name in sorted(kernels):
+        k = kernels[name]
+        print("%-32s %9d %6d %6s" % (name, k["cycles"], k["stack_bytes"], k["flash_bytes"]))
+    print("Results in " + path)
+    return 0
+
+
+env.AddCustomTarget(
+    name="bench",
+    dependencies="$BUILD_DIR/${PROGNAME}.elf",
+    actions=run_bench,
+    title="Benchmark",
+    description="Run the control loop kernel benchmarks under simavr",
+)
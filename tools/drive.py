@@ -0,0 +1,115 @@
+# ONI - Objeto Não Identificado
+# Drives the robot from a host over its USART1 link (lib/SerialDrive)
+#
+#   python3 tools/drive.py /dev/ttyUSB0 tools/sim/scenarios/turns.txt
+#   python3 tools/drive.py /dev/ttyUSB0 --drive --rate 500 tools/sim/scenarios/straight.txt
+#
+# Select the link on the robot's console first: set input 1. Scenario files
+# are the drive simulator's "time_ms lx ry" steps, with an optional fourth
+# column holding a button word (PSB_* bits, 1 = pressed). Commands go out
+# at --rate per second, each one carrying the latest step, until the time
+# of the last step. --drive taps R3 first, which enters DRIVE mode. When
+# the script ends the sticks are centred for a moment and the link goes
+# quiet, so the robot stops on its command timeout. Needs pyserial.
+
+import argparse
+import time
+
+import serial
+
+SYNC = 0xA5
+PSB_R3 = 0x0004
+CENTRE = 128
+TAP_SECONDS = 0.2  # several control cycles, so the press and the release are both sampled
+SETTLE_SECONDS = 0.5
+
+
+def crc8(data):
+    """CRC-8, polynomial 0x07 starting at 0: avr-libc's _crc8_ccitt_update()"""
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def frame(seq, lx, ly, rx, ry, buttons):
+    body = bytes([seq & 0xFF, lx, ly, rx, ry, buttons & 0xFF, (buttons >> 8) & 0xFF])
+    return bytes([SYNC]) + body + bytes([crc8(body)])
+
+
+def load(path):
+    steps = []
+    with open(path) as f:
+        for line in f:
+            fields = line.split("#", 1)[0].split()
+            if not fields:
+                continue
+            time_ms, lx, ry = (int(v) for v in fields[:3])
+            buttons = int(fields[3], 0) if len(fields) > 3 else 0
+            steps.append((time_ms, lx, ry, buttons))
+    return steps
+
+
+class Link:
+    def __init__(self, port, baud, rate):
+        self.port = serial.Serial(port, baud)
+        self.period = 1.0 / rate
+        self.seq = 0
+        self.sent = 0
+
+    def send(self, lx, ry, buttons):
+        self.port.write(frame(self.seq, lx, CENTRE, CENTRE, ry, buttons))
+        self.seq = (self.seq + 1) & 0xFF
+        self.sent += 1
+
+    def play(self, steps):
+        """Sends the latest step at a steady rate until the time of the last one"""
+        start = time.monotonic()
+        end = steps[-1][0] / 1000.0
+        n = 0
+        current = 0
+        while True:
+            due = start + n * self.period
+            delay = due - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+            elapsed = due - start
+            if elapsed > end:
+                return
+            while current + 1 < len(steps) and steps[current + 1][0] / 1000.0 <= elapsed:
+                current += 1
+            _, lx, ry, buttons = steps[current]
+            self.send(lx, ry, buttons)
+            n += 1
+
+    def hold(self, seconds, lx, ry, buttons):
+        self.play([(0, lx, ry, buttons), (int(seconds * 1000), lx, ry, buttons)])
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Drives the robot over its USART1 link")
+    parser.add_argument("port")
+    parser.add_argument("scenario")
+    parser.add_argument("--baud", type=int, default=250000, help="UART_BAUD in oni.cpp")
+    parser.add_argument("--rate", type=float, default=100, help="commands per second")
+    parser.add_argument("--drive", action="store_true", help="tap R3 first to enter DRIVE mode")
+    args = parser.parse_args()
+
+    steps = load(args.scenario)
+    link = Link(args.port, args.baud, args.rate)
+    if args.drive:
+        link.hold(TAP_SECONDS, CENTRE, CENTRE, PSB_R3)
+        link.hold(TAP_SECONDS, CENTRE, CENTRE, 0)
+    before = link.sent
+    start = time.monotonic()
+    link.play(steps)
+    took = time.monotonic() - start
+    played = link.sent - before
+    link.hold(SETTLE_SECONDS, CENTRE, CENTRE, 0)
+    print("%d commands in %.2f s, %.1f per second" % (played, took, played / took if took > 0 else 0))
+
+
+if __name__ == "__main__":
+    main()
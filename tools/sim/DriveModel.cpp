@@ -0,0 +1,70 @@
+/*
+ * DriveModel.cpp - Differential drive robot model for the host simulator
+ * Part of ONI - Objeto Não Identificado
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include "DriveModel.h"
+
+#define DT 0.001 //one step is 1 ms
+
+DriveModel::DriveModel(const DriveParameters &parameters)
+{
+    p = parameters;
+    if (p.latency >= DRIVE_MODEL_MAX_LATENCY)
+    {
+        p.latency = DRIVE_MODEL_MAX_LATENCY - 1;
+    }
+    reset();
+}
+
+void DriveModel::reset()
+{
+    x = y = heading = 0;
+    left = right = 0;
+    for (unsigned i = 0; i < DRIVE_MODEL_MAX_LATENCY; i++)
+    {
+        queue[i][0] = queue[i][1] = 0;
+    }
+    head = 0;
+}
+
+//Steady wheel speed for a PWM
+double DriveModel::target(int pwm)
+{
+    int magnitude = abs(pwm);
+    if (magnitude <= p.deadband)
+    {
+        return 0;
+    }
+    double speed = p.topSpeed * (magnitude - p.deadband) / (255 - p.deadband);
+    return pwm > 0 ? speed : -speed;
+}
+
+//Advances 1 ms with the PWMs just written to the engines
+void DriveModel::step(int pwmLeft, int pwmRight)
+{
+    queue[head][0] = pwmLeft;
+    queue[head][1] = pwmRight;
+    unsigned applied = (head + DRIVE_MODEL_MAX_LATENCY - p.latency) % DRIVE_MODEL_MAX_LATENCY;
+    head = (head + 1) % DRIVE_MODEL_MAX_LATENCY;
+
+    double k = p.tau > 0 ? DT / (p.tau + DT) : 1; //backward Euler, stable at any tau
+    left += (target(queue[applied][0]) - left) * k;
+    right += (target(queue[applied][1]) - right) * k;
+
+    heading += yawRate() * DT;
+    x += speed() * cos(heading) * DT;
+    y += speed() * sin(heading) * DT;
+}
+
+double DriveModel::speed()
+{
+    return (left + right) / 2;
+}
+
+double DriveModel::yawRate()
+{
+    return (right - left) / p.wheelBase;
+}
@@ -0,0 +1,44 @@
+/*
+ * DriveModel.h - Differential drive robot model for the host simulator
+ * Part of ONI - Objeto Não Identificado
+ *
+ * Each wheel is a motor with a dead band (PWM below it doesn't move the
+ * wheel) and a first order response towards a speed proportional to the
+ * PWM above the dead band. The PWM reaches the motors after a transport
+ * latency. Wheel speeds are integrated into a pose.
+ */
+
+#ifndef DRIVEMODEL_H
+#define DRIVEMODEL_H
+
+#include <stdint.h>
+
+#define DRIVE_MODEL_MAX_LATENCY 256 //ms
+
+struct DriveParameters
+{
+    double tau; //motor time constant, s
+    int deadband; //PWM that barely moves a wheel
+    unsigned latency; //from PWM written to motor responding, ms
+    double wheelBase; //distance between the wheels, m
+    double topSpeed; //wheel speed at full PWM, m/s
+};
+
+class DriveModel
+{
+  public:
+    DriveModel(const DriveParameters &);
+    void reset();
+    void step(int, int);
+    double x, y, heading; //m, m, rad. Starts at the origin facing +x
+    double left, right; //wheel speeds, m/s
+    double speed(); //forward speed, m/s
+    double yawRate(); //rad/s, positive turns left
+  private:
+    double target(int);
+    DriveParameters p;
+    int queue[DRIVE_MODEL_MAX_LATENCY][2]; //PWMs in flight
+    unsigned head;
+};
+
+#endif
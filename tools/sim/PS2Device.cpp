@@ -0,0 +1,366 @@
+/*
+ * PS2Device.cpp - Bit level model of a PS2 controller for the host emulator
+ * Part of ONI - Objeto Não Identificado
+ */
+
+#include <string.h>
+#include "Arduino.h"
+#include "PS2Device.h"
+
+#define STICK_BITS 0x000F
+#define PRESSURE_BITS 0xFFF0
+#define WIRING_DEVICES 4
+
+//PSB_* bit of each pressure byte, in PSAB_* order: right left up down triangle circle cross square L1 R1 L2 R2
+static const uint16_t PRESSURE_BUTTONS[12] = {0x0020, 0x0080, 0x0010, 0x0040, 0x1000, 0x2000, 0x4000, 0x8000, 0x0400, 0x0800, 0x0100, 0x0200};
+
+PS2Device::PS2Device(uint8_t _type, uint32_t seed)
+{
+    memset(&faults, 0, sizeof(faults));
+    memset(&counters, 0, sizeof(counters));
+    type = _type;
+    analog = locked = config = false; //digital at power up
+    responseMask = 0;
+    memset(motorMap, 0xFF, sizeof(motorMap));
+    motors[0] = motors[1] = 0;
+    buttons = 0;
+    memset(sticks, 128, sizeof(sticks));
+    selected = addressed = false;
+    length = 0;
+    byteIndex = bitIndex = shift = 0;
+    out = true;
+    missed = false;
+    dropAt = -1;
+    bitCount = 0;
+    readyAt = 0;
+    random = seed ? seed : 1;
+}
+
+void PS2Device::setButtons(uint16_t pressed)
+{
+    buttons = pressed;
+}
+
+void PS2Device::setSticks(uint8_t lx, uint8_t ly, uint8_t rx, uint8_t ry)
+{
+    sticks[0] = rx;
+    sticks[1] = ry;
+    sticks[2] = lx;
+    sticks[3] = ly;
+}
+
+//xorshift32, the same sequence on every host
+bool PS2Device::chance(double probability)
+{
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    return probability > 0 && random < probability * 4294967296.0;
+}
+
+uint8_t PS2Device::mode() const
+{
+    if (config)
+    {
+        return 0xF3;
+    }
+    if (!analog)
+    {
+        return 0x41;
+    }
+    uint8_t bytes = 2; //buttons
+    for (uint8_t bit = 0; bit < 16; bit++)
+    {
+        if (responseMask & (1UL << bit))
+        {
+            bytes++;
+        }
+    }
+    return 0x70 | ((bytes + 1) / 2);
+}
+
+uint8_t PS2Device::replyLength() const
+{
+    return 3 + 2 * (mode() & 0x0F);
+}
+
+//Header of the reply, from the state when the transaction starts
+void PS2Device::prepare()
+{
+    memset(reply, 0x00, sizeof(reply));
+    reply[0] = 0xFF;
+    reply[1] = mode();
+    reply[2] = 0x5A;
+    length = replyLength();
+}
+
+//Data of a poll reply, with this poll's faults
+void PS2Device::poll()
+{
+    counters.polls++;
+    uint16_t pressed = buttons;
+    const uint8_t *values = sticks;
+    static const uint8_t PARKED[4] = {115, 115, 115, 115};
+    if (chance(faults.brownout))
+    {
+        pressed = 0xFFFF;
+        counters.brownouts++;
+    }
+    if (analog && chance(faults.sticks115))
+    {
+        values = PARKED;
+        counters.sticks115++;
+    }
+    reply[3] = ~pressed & 0xFF; //active low
+    reply[4] = ~pressed >> 8;
+    uint8_t at = 5;
+    for (uint8_t bit = 0; analog && bit < 16; bit++)
+    {
+        if (!(responseMask & (1UL << bit)))
+        {
+            continue;
+        }
+        if (bit < 4)
+        {
+            reply[at++] = values[bit];
+        }
+        else
+        {
+            reply[at++] = (pressed & PRESSURE_BUTTONS[bit - 4]) ? 0xFF : 0x00;
+        }
+    }
+    if (analog && chance(faults.revert))
+    {
+        analog = locked = false; //this reply still goes out whole, the next one is digital
+        responseMask = 0;
+        counters.reverts++;
+    }
+}
+
+void PS2Device::attention(bool select, uint64_t now)
+{
+    if (select == selected)
+    {
+        return;
+    }
+    selected = select;
+    if (selected)
+    {
+        counters.transactions++;
+        addressed = false;
+        byteIndex = bitIndex = shift = 0;
+        bitCount = 0;
+        missed = false;
+        readyAt = now;
+        dropAt = chance(faults.dropBit) ? 8 + random % (8 * (replyLength() - 1)) : -1;
+        memset(command, 0, sizeof(command));
+        prepare();
+    }
+    else
+    {
+        finish();
+        out = true;
+    }
+}
+
+void PS2Device::clock(bool high, bool cmd, uint64_t now)
+{
+    if (!selected || faults.detached)
+    {
+        return;
+    }
+    if (!high) //falling edge, next bit out
+    {
+        missed = false;
+        if (now < readyAt)
+        {
+            missed = true;
+            counters.slowAck++;
+            return;
+        }
+        if (bitCount == dropAt)
+        {
+            missed = true;
+            dropAt = -1;
+            counters.dropped++;
+            return;
+        }
+        out = !(addressed && byteIndex < length) || ((reply[byteIndex] >> bitIndex) & 1);
+        if (byteIndex == 0)
+        {
+            out = true; //byte 0 is still the host addressing us
+        }
+        return;
+    }
+    if (missed) //rising edge of a missed clock
+    {
+        return;
+    }
+    if (cmd)
+    {
+        shift |= 1 << bitIndex;
+    }
+    bitCount++;
+    if (++bitIndex < 8)
+    {
+        return;
+    }
+
+    //A whole byte in
+    if (byteIndex < PS2_REPLY_MAX)
+    {
+        command[byteIndex] = shift;
+    }
+    if (byteIndex == 0)
+    {
+        addressed = shift == 0x01;
+    }
+    else if (byteIndex == 1 && addressed)
+    {
+        if (config)
+        {
+            if (shift == 0x45)
+            {
+                reply[3] = type;
+                reply[4] = 0x02;
+                reply[5] = analog ? 0x01 : 0x00;
+                reply[6] = 0x02;
+                reply[7] = 0x01;
+                reply[8] = 0x00;
+            }
+        }
+        else if (shift == 0x42 || shift == 0x43)
+        {
+            poll();
+        }
+    }
+    byteIndex++;
+    bitIndex = 0;
+    shift = 0;
+    readyAt = now + faults.ackDelay * 1000ULL;
+}
+
+//Applies the command once ATT goes high
+void PS2Device::finish()
+{
+    if (!addressed || byteIndex < 2)
+    {
+        return;
+    }
+    uint8_t received = byteIndex; //whole bytes
+    switch (command[1])
+    {
+        case 0x42:
+            for (uint8_t i = 3; i < received && i < 9; i++)
+            {
+                if (motorMap[i - 3] <= 1)
+                {
+                    motors[motorMap[i - 3]] = command[i];
+                }
+            }
+            break;
+
+        case 0x43:
+            if (received > 3)
+            {
+                if (command[3] == 0x01 && !config)
+                {
+                    counters.configs++;
+                }
+                config = command[3] == 0x01;
+            }
+            break;
+
+        case 0x44:
+            if (config && received > 4)
+            {
+                analog = command[3] == 0x01;
+                locked = command[4] == 0x03;
+                responseMask = analog ? responseMask | STICK_BITS : 0;
+            }
+            break;
+
+        case 0x4D:
+            for (uint8_t i = 3; config && i < received && i < 9; i++)
+            {
+                motorMap[i - 3] = command[i];
+            }
+            break;
+
+        case 0x4F:
+            if (config && analog && received > 5)
+            {
+                responseMask = command[3] | (uint32_t(command[4]) << 8) | (uint32_t(command[5]) << 16);
+            }
+            break;
+    }
+}
+
+bool PS2Device::data() const
+{
+    return faults.detached || !selected || out;
+}
+
+static uint8_t wiringClk, wiringCmd, wiringDat;
+static PS2Device *wired[WIRING_DEVICES];
+static uint8_t wiredAtt[WIRING_DEVICES];
+static uint8_t wiredCount;
+
+static void wiringWrite(uint8_t pin, bool level)
+{
+    for (uint8_t i = 0; i < wiredCount; i++)
+    {
+        if (pin == wiringClk)
+        {
+            wired[i]->clock(level, hostPin(wiringCmd), hostNanos());
+        }
+        else if (pin == wiredAtt[i])
+        {
+            wired[i]->attention(!level, hostNanos());
+        }
+    }
+}
+
+static bool wiringRead(uint8_t pin)
+{
+    if (pin != wiringDat)
+    {
+        return true;
+    }
+    for (uint8_t i = 0; i < wiredCount; i++)
+    {
+        if (!wired[i]->data())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void PS2Wiring::connect(uint8_t clk, uint8_t cmd, uint8_t dat)
+{
+    wiringClk = clk;
+    wiringCmd = cmd;
+    wiringDat = dat;
+    wiredCount = 0;
+    hostAttach(wiringWrite, wiringRead);
+}
+
+bool PS2Wiring::attach(PS2Device &device, uint8_t att)
+{
+    if (wiredCount == WIRING_DEVICES)
+    {
+        return false;
+    }
+    digitalWrite(att, HIGH); //deselected, before the device listens
+    wired[wiredCount] = &device;
+    wiredAtt[wiredCount] = att;
+    wiredCount++;
+    return true;
+}
+
+void PS2Wiring::disconnect()
+{
+    wiredCount = 0;
+    hostAttach(NULL, NULL);
+}
@@ -0,0 +1,116 @@
+/*
+ * PS2Device.h - Bit level model of a PS2 controller for the host emulator
+ * Part of ONI - Objeto Não Identificado
+ *
+ * Follows the DualShock protocol the way PS2X_lib drives it: ATT low
+ * starts a transaction, the controller puts each reply bit on DAT at the
+ * falling CLK edge and takes each command bit from CMD at the rising one,
+ * LSB first. Byte 0 must be the 0x01 address, byte 1 is the command and
+ * the reply header is 0xFF, mode, 0x5A. The mode byte is 0x41 in digital
+ * mode, 0x7n in analog mode with n 16-bit words of data, and 0xF3 in
+ * config mode. Commands:
+ *
+ *   0x42  poll. Bytes 3~8 drive the motors mapped by 0x4D
+ *   0x43  poll outside config mode; byte 3 enters (1) or exits (0) config
+ *   0x44  config: byte 3 selects analog (1) or digital (0), byte 4 == 3 locks it
+ *   0x45  config: model, reply byte 3 is the type (0x03 DualShock, 0x0C wireless)
+ *   0x4D  config: maps bytes 3~8 of later polls to motors, 0x00 small and 0x01 large
+ *   0x4F  config: response mask over the 4 sticks and 12 pressures, bytes 3~5
+ *
+ * Commands take effect when ATT goes high. Faults are drawn per
+ * transaction from a seeded generator, so runs repeat exactly.
+ */
+
+#ifndef PS2DEVICE_H
+#define PS2DEVICE_H
+
+#include <stdint.h>
+
+#define PS2_DUALSHOCK 0x03
+#define PS2_WIRELESS 0x0C
+#define PS2_REPLY_MAX 21 //header plus 9 words
+
+struct PS2Faults
+{
+    double dropBit; //chance per transaction of missing a clock, every later bit comes out one place late
+    unsigned ackDelay; //us the controller needs after each byte before it follows the clock again
+    double brownout; //chance per poll of a frame with every button pressed
+    double sticks115; //chance per poll of all four sticks parked at 115
+    double revert; //chance per poll of falling back to digital mode, as after a supply glitch
+    bool detached; //nothing answers, DAT stays on the pull-up
+};
+
+struct PS2DeviceStats
+{
+    unsigned long transactions;
+    unsigned long polls;
+    unsigned long configs; //config mode entries
+    unsigned long dropped; //clocks missed on purpose
+    unsigned long slowAck; //clocks missed for coming before the controller was ready
+    unsigned long brownouts;
+    unsigned long sticks115;
+    unsigned long reverts;
+};
+
+class PS2Device
+{
+  public:
+    PS2Device(uint8_t type = PS2_DUALSHOCK, uint32_t seed = 1);
+    void setButtons(uint16_t); //PSB_* bits, 1 is pressed
+    void setSticks(uint8_t, uint8_t, uint8_t, uint8_t); //lx ly rx ry
+    PS2Faults faults;
+
+    //Bus side, see PS2Wiring
+    void attention(bool, uint64_t); //selected, now in ns
+    void clock(bool, bool, uint64_t); //clock level, command level, now in ns
+    bool data() const;
+
+    uint8_t mode() const; //mode byte of the next reply
+    bool configMode() const { return config; }
+    uint8_t motor(uint8_t which) const { return motors[which]; } //0 small, 1 large
+    uint32_t mask() const { return responseMask; }
+    const PS2DeviceStats &stats() const { return counters; }
+
+  private:
+    bool chance(double);
+    uint8_t replyLength() const;
+    void prepare();
+    void poll();
+    void finish();
+
+    //Controller state
+    uint8_t type;
+    bool analog, locked, config;
+    uint32_t responseMask; //bit 0~3 sticks RX RY LX LY, 4~15 pressures in PSAB_* order
+    uint8_t motorMap[6]; //per poll byte 3~8: 0x00 small motor, 0x01 large, 0xFF none
+    uint8_t motors[2];
+    uint16_t buttons; //pressed = 1
+    uint8_t sticks[4]; //RX RY LX LY, in reply order
+
+    //Transaction
+    bool selected, addressed;
+    uint8_t reply[PS2_REPLY_MAX];
+    uint8_t length; //reply bytes, DAT is let go after them
+    uint8_t command[PS2_REPLY_MAX];
+    uint8_t byteIndex, bitIndex, shift;
+    bool out; //DAT level
+    bool missed; //the falling edge was missed, so is the rising one
+    long dropAt; //bit count to miss, -1 for none
+    long bitCount;
+    uint64_t readyAt; //ns, edges before this are missed
+
+    uint32_t random;
+    PS2DeviceStats counters;
+};
+
+//Wires devices to the host core pins: shared CLK, CMD and DAT, one ATT each. DAT is open collector,
+//so it reads low when any device pulls it low
+class PS2Wiring
+{
+  public:
+    static void connect(uint8_t, uint8_t, uint8_t); //clk cmd dat
+    static bool attach(PS2Device &, uint8_t); //att pin. False when full
+    static void disconnect();
+};
+
+#endif
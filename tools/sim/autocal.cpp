@@ -0,0 +1,255 @@
+/*
+ * autocal.cpp - AutoCal against a host motor model
+ * Part of ONI - Objeto Não Identificado
+ *
+ * Runs the firmware's own stall search (AutoCal) the way oni.cpp's
+ * autoCalibrationManager() does, every output cycle, against one wheel of
+ * a DriveModel. While the wheel coasts, its sense input reads the back-EMF
+ * through a 1:1 divider, summed over an AdcScanner block. For the first
+ * few ms after the drive is cut, it reads the inductive kick instead.
+ *
+ * For each motor the expected stall PWM is found by brute force: the
+ * lowest PWM whose probe, started from rest, reads above the threshold.
+ * The search must land within its resolution of it, and never at or below
+ * the model's dead band, where the engine curves would start from a PWM
+ * that doesn't move the wheel. A jammed wheel and a missing sense input
+ * must fail. Exits with 1 when any check fails.
+ *
+ * A wheel that moved has to stop during the rest time, or the next probe
+ * starts from a wheel still turning and the search lands low. With the
+ * firmware's 300 ms that holds for time constants up to about 0.12 s: try
+ * --rest 300 against a heavier wheel by editing motors[] below.
+ *
+ *   autocal [options]
+ *
+ * Options (defaults in brackets, the firmware's in oni.cpp):
+ *   --threshold n    summed block reading that means spinning [2600]
+ *   --settle ms      drive time per probe [150]
+ *   --blanking ms    coast before sampling [4]
+ *   --rest ms        coast after a probe that moved [300]
+ *   --resolution n   PWM steps the search stops at [2]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "AutoCal.h"
+#include "DriveModel.h"
+
+#define OUTPUT_PERIOD 10 //ms, outputManager() runs autoCalibrationManager() this often
+#define BLOCK_SAMPLES 64 //AdcScanner block, 1 << ADC_SCANNER_SHIFT
+#define BLOCK_TIME 7 //ms a block takes, 64 conversions of 104 us
+#define BATTERY_MV 7400 //back-EMF at top speed
+#define ADC_FULL_MV 5000
+#define DIVIDER 2 //sense input divider
+#define KICK_TIME 2 //ms the inductive kick holds the sense input at full scale after the drive is cut
+#define MAX_RUN 60000 //ms, a search taking longer has hung
+
+struct Options
+{
+    uint16_t threshold;
+    uint16_t settle;
+    uint16_t blanking;
+    uint16_t rest;
+    uint8_t resolution;
+};
+
+struct Motor
+{
+    const char *name;
+    int deadband;
+    double tau;
+    bool sense; //the sense input is wired
+};
+
+//One wheel of a DriveModel with its sense input
+class Wheel
+{
+  public:
+    Wheel(const Motor &motor) : model(parameters(motor)), connected(motor.sense), pwm(0), coasting(0) {}
+
+    //Advances 1 ms driving pwm, 0 coasts
+    void step(int _pwm)
+    {
+        coasting = _pwm == 0 ? coasting + 1 : 0;
+        pwm = _pwm;
+        model.step(pwm, 0);
+    }
+
+    //ADC counts of one conversion of the sense input now
+    uint16_t sample()
+    {
+        if (!connected)
+        {
+            return 0;
+        }
+        double mv;
+        if (pwm != 0 || coasting <= KICK_TIME)
+        {
+            mv = BATTERY_MV; //driven, or the kick: the input sits at the supply
+        }
+        else
+        {
+            mv = fabs(model.left) / TOP_SPEED * BATTERY_MV;
+        }
+        double counts = mv / DIVIDER * 1023 / ADC_FULL_MV;
+        return counts > 1023 ? 1023 : (uint16_t)counts;
+    }
+
+  private:
+    static constexpr double TOP_SPEED = 0.8;
+
+    static DriveParameters parameters(const Motor &motor)
+    {
+        DriveParameters p;
+        p.tau = motor.tau;
+        p.deadband = motor.deadband;
+        p.latency = 0;
+        p.wheelBase = 0.15;
+        p.topSpeed = TOP_SPEED;
+        return p;
+    }
+
+    DriveModel model;
+    bool connected;
+    int pwm;
+    unsigned coasting; //ms since the drive was cut
+};
+
+//Runs one search, the way autoCalibrationManager() does. Returns the final state
+static uint8_t search(const Options &o, const Motor &motor, AutoCal &cal, unsigned long &took)
+{
+    Wheel wheel(motor);
+    cal.setTiming(o.settle, o.blanking, o.rest);
+    cal.setThreshold(o.threshold);
+    cal.setResolution(o.resolution);
+    cal.start(0, 0, 255);
+    uint8_t state = cal.state();
+    uint32_t blockSum = 0; //conversions since the last drop
+    unsigned blockCount = 0;
+    int pwm = 0;
+    unsigned long t;
+    for (t = 0; t < MAX_RUN && cal.busy(); t++)
+    {
+        if (t % OUTPUT_PERIOD == 0)
+        {
+            uint8_t previous = state;
+            state = cal.step(t);
+            if (state == AUTOCAL_SAMPLE)
+            {
+                if (previous != AUTOCAL_SAMPLE)
+                {
+                    blockSum = blockCount = 0; //AdcScanner::drop()
+                }
+                else if (blockCount >= BLOCK_TIME && motor.sense) //AdcScanner::take() has a block
+                {
+                    cal.sense(blockSum * BLOCK_SAMPLES / blockCount);
+                }
+            }
+            pwm = cal.duty();
+        }
+        wheel.step(pwm);
+        if (blockCount < BLOCK_TIME)
+        {
+            blockSum += wheel.sample();
+            blockCount++;
+        }
+    }
+    took = t;
+    return cal.state();
+}
+
+//Whether a single probe at pwm, from rest, reads above the threshold. Same timing as search()
+static bool moves(const Options &o, const Motor &motor, int pwm)
+{
+    Wheel wheel(motor);
+    unsigned long t = 0;
+    for (; t < o.settle; t++)
+    {
+        wheel.step(pwm);
+    }
+    unsigned long sampleAt = t + o.blanking; //the first output cycle in AUTOCAL_SAMPLE drops, the block starts there
+    sampleAt = (sampleAt + OUTPUT_PERIOD - 1) / OUTPUT_PERIOD * OUTPUT_PERIOD;
+    for (; t < sampleAt; t++)
+    {
+        wheel.step(0);
+    }
+    uint32_t sum = 0;
+    for (unsigned i = 0; i < BLOCK_TIME; i++, t++)
+    {
+        wheel.step(0);
+        sum += wheel.sample();
+    }
+    return sum * BLOCK_SAMPLES / BLOCK_TIME > o.threshold;
+}
+
+static bool check(const Options &o, const Motor &motor)
+{
+    AutoCal cal;
+    unsigned long took;
+    uint8_t state = search(o, motor, cal, took);
+    int expected = -1;
+    for (int pwm = 0; pwm <= 255 && expected < 0; pwm++)
+    {
+        if (moves(o, motor, pwm))
+        {
+            expected = pwm;
+        }
+    }
+
+    bool ok;
+    if (expected < 0 || !motor.sense)
+    {
+        ok = state == AUTOCAL_FAILED;
+        printf("%-24s deadband %3d tau %.2f: %s after %lu ms, %u probes, expected to fail: %s\n", motor.name, motor.deadband, motor.tau, state == AUTOCAL_FAILED ? "failed" : "done", took, cal.probes(), ok ? "ok" : "FAIL");
+        return ok;
+    }
+    int found = cal.result();
+    ok = state == AUTOCAL_DONE && abs(found - expected) <= o.resolution && found > motor.deadband;
+    printf("%-24s deadband %3d tau %.2f: stall %3d expected %3d in %lu ms, %u probes: %s\n", motor.name, motor.deadband, motor.tau, state == AUTOCAL_DONE ? found : -1, expected, took, cal.probes(), ok ? "ok" : "FAIL");
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    Options o = {2600, 150, 4, 300, 2};
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "%s needs a value\n", arg);
+            return 2;
+        }
+        long value = strtol(argv[++i], NULL, 0);
+        if (!strcmp(arg, "--threshold")) o.threshold = value;
+        else if (!strcmp(arg, "--settle")) o.settle = value;
+        else if (!strcmp(arg, "--blanking")) o.blanking = value;
+        else if (!strcmp(arg, "--rest")) o.rest = value;
+        else if (!strcmp(arg, "--resolution")) o.resolution = value;
+        else
+        {
+            fprintf(stderr, "unknown option %s, see the top of tools/sim/autocal.cpp\n", arg);
+            return 2;
+        }
+    }
+
+    const Motor motors[] =
+    {
+        {"free", 30, 0.12, true},
+        {"typical", 60, 0.12, true},
+        {"stiff", 90, 0.12, true},
+        {"very stiff", 140, 0.12, true},
+        {"fast", 60, 0.05, true},
+        {"light", 60, 0.1, true},
+        {"jammed", 255, 0.12, true},
+        {"sense not wired", 60, 0.12, false},
+    };
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(motors) / sizeof(motors[0]); i++)
+    {
+        ok = check(o, motors[i]) && ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,366 @@
+/*
+ * handoff.cpp - Handoff.h under a simulated interrupt, on the host
+ * Part of ONI - Objeto Não Identificado
+ *
+ * Every HANDOFF_BARRIER() in Handoff.h, and every word of an item being
+ * copied in or out, is a point where the interrupt may fire. This run
+ * redefines the barrier to count those points down and runs the interrupt
+ * side to completion when the count reaches 0, the way the AVR would. The
+ * count restarts at random from a seeded generator, so every gap between
+ * two points gets hit again and again and runs repeat exactly.
+ *
+ * Items are 4 words all derived from one serial number, so a copy mixing
+ * two items shows up. Each structure runs both ways its header allows:
+ *
+ *   SpscRing   interrupt producing, loop consuming, and the other way
+ *              around: items come out in order, none lost or duplicated,
+ *              and dropped() counts every refused push, mod 256.
+ *   Seqlock    interrupt writing, loop reading: no torn copy is taken,
+ *              serials never go back, and version() counts the writes
+ *              mod 256. Torn copies must have been caught by tryRead(),
+ *              or the run never hit the window it's checking.
+ *   DoubleBuffer  loop writing, interrupt reading: no torn copy, serials
+ *              never go back.
+ *
+ *   handoff [options]
+ *
+ * Options (defaults in brackets):
+ *   --rounds n    loop operations per run [200000]
+ *   --seed n      preemption generator seed [1]
+ *
+ * Exits with 1 when any check fails.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void preemption();
+#define HANDOFF_BARRIER() preemption()
+#include "Handoff.h"
+
+#define WORDS 4
+#define RING 8
+#define SEQLOCK_POINTS (WORDS + 2) //preemption points in one tryRead()
+
+struct Options
+{
+    unsigned long rounds;
+    uint32_t seed;
+};
+
+//Interrupt model: preemption() fires the handler once every few points
+static void (*handler)() = NULL;
+static bool inHandler = false;
+static unsigned countdown = 0;
+static unsigned spread = 8; //countdowns are drawn from 0~spread-1, lower fires more often
+static uint32_t state = 1;
+
+static uint32_t next()
+{
+    state ^= state << 13; //xorshift32
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static void preemption()
+{
+    if (handler == NULL || inHandler)
+    {
+        return; //the interrupt doesn't nest
+    }
+    if (countdown > 0)
+    {
+        countdown--;
+        return;
+    }
+    countdown = next() % spread;
+    inHandler = true;
+    handler();
+    inHandler = false;
+}
+
+//4 words of one serial number. Copies go word by word, with a preemption point after each
+struct Item
+{
+    uint32_t words[WORDS];
+
+    Item() { set(0); }
+
+    Item &operator=(const Item &other)
+    {
+        for (uint8_t i = 0; i < WORDS; i++)
+        {
+            words[i] = other.words[i];
+            preemption();
+        }
+        return *this;
+    }
+
+    void set(uint32_t serial)
+    {
+        for (uint8_t i = 0; i < WORDS; i++)
+        {
+            words[i] = serial * WORDS + i;
+        }
+    }
+
+    uint32_t serial() const { return words[0] / WORDS; }
+
+    bool torn() const
+    {
+        for (uint8_t i = 1; i < WORDS; i++)
+        {
+            if (words[i] != words[0] + i)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+//Varies how often the interrupt fires, so the ring runs full and empty in turn. Some countdowns are at least
+//least - 1 points long: a Seqlock reader spins forever if the interrupt fires during every copy
+static void phase(unsigned long round, unsigned least = 1)
+{
+    if (round % 1000 == 0)
+    {
+        spread = least + next() % 16;
+    }
+}
+
+struct Tally
+{
+    unsigned long moved, refused, torn, order;
+};
+
+static Tally tally;
+static uint32_t produced, consumed; //serial of the next item in and out
+
+static bool report(const char *name, bool ok, const char *detail)
+{
+    printf("%-34s %s: %s\n", name, detail, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+static void check(const Item &item)
+{
+    if (item.torn())
+    {
+        tally.torn++;
+    }
+    else if (item.serial() != consumed)
+    {
+        tally.order++;
+    }
+    consumed = item.serial() + 1;
+    tally.moved++;
+}
+
+//SpscRing, interrupt producing
+static SpscRing<Item, RING> ringIn;
+
+static void producerInterrupt()
+{
+    Item item;
+    item.set(produced);
+    if (ringIn.push(item))
+    {
+        produced++;
+    }
+    else
+    {
+        tally.refused++;
+    }
+}
+
+static bool ringFromInterrupt(const Options &o)
+{
+    memset(&tally, 0, sizeof(tally));
+    produced = consumed = 0;
+    handler = producerInterrupt;
+    for (unsigned long round = 0; round < o.rounds; round++)
+    {
+        phase(round);
+        Item item;
+        if (ringIn.pop(item))
+        {
+            check(item);
+        }
+        preemption(); //the rest of the loop
+    }
+    handler = NULL;
+    Item item;
+    while (ringIn.pop(item))
+    {
+        check(item);
+    }
+    char detail[160];
+    bool ok = tally.torn == 0 && tally.order == 0 && tally.moved == produced && ringIn.dropped() == uint8_t(tally.refused) && tally.refused > 0;
+    snprintf(detail, sizeof(detail), "%lu in order of %lu pushed, %lu torn, %lu out of order, %lu refused, dropped() %u", tally.moved - tally.order, (unsigned long)produced, tally.torn, tally.order, tally.refused, ringIn.dropped());
+    return report("SpscRing, interrupt producing", ok, detail);
+}
+
+//SpscRing, interrupt consuming
+static SpscRing<Item, RING> ringOut;
+
+static void consumerInterrupt()
+{
+    Item item;
+    if (ringOut.pop(item))
+    {
+        check(item);
+    }
+}
+
+static bool ringToInterrupt(const Options &o)
+{
+    memset(&tally, 0, sizeof(tally));
+    produced = consumed = 0;
+    handler = consumerInterrupt;
+    for (unsigned long round = 0; round < o.rounds; round++)
+    {
+        phase(round);
+        Item item;
+        item.set(produced);
+        if (ringOut.push(item))
+        {
+            produced++;
+        }
+        else
+        {
+            tally.refused++;
+        }
+        preemption();
+    }
+    handler = NULL;
+    while (!ringOut.empty())
+    {
+        consumerInterrupt();
+    }
+    char detail[160];
+    bool ok = tally.torn == 0 && tally.order == 0 && tally.moved == produced && ringOut.dropped() == uint8_t(tally.refused) && tally.refused > 0;
+    snprintf(detail, sizeof(detail), "%lu in order of %lu pushed, %lu torn, %lu out of order, %lu refused, dropped() %u", tally.moved - tally.order, (unsigned long)produced, tally.torn, tally.order, tally.refused, ringOut.dropped());
+    return report("SpscRing, interrupt consuming", ok, detail);
+}
+
+//Seqlock, interrupt writing
+static Seqlock<Item> latest;
+static uint32_t written;
+
+static void writerInterrupt()
+{
+    Item item;
+    item.set(++written);
+    latest.write(item);
+}
+
+static bool seqlock(const Options &o)
+{
+    written = 0;
+    handler = writerInterrupt;
+    unsigned long reads = 0, retries = 0, caught = 0, torn = 0, backwards = 0, versions = 0;
+    uint32_t last = 0;
+    for (unsigned long round = 0; round < o.rounds; round++)
+    {
+        phase(round, SEQLOCK_POINTS + 1);
+        Item item;
+        while (!latest.tryRead(item))
+        {
+            retries++;
+            caught += item.torn();
+        }
+        reads++;
+        torn += item.torn();
+        backwards += item.serial() < last;
+        last = item.serial();
+        handler = NULL; //as if read with the interrupt held off, to compare
+        versions += latest.version() != uint8_t(written);
+        handler = writerInterrupt;
+        preemption();
+    }
+    handler = NULL;
+    char detail[200];
+    bool ok = torn == 0 && backwards == 0 && versions == 0 && caught > 0 && written > 256;
+    snprintf(detail, sizeof(detail), "%lu reads of %lu writes, %lu retries, %lu torn caught, %lu torn taken, %lu backwards, %lu wrong versions", reads, (unsigned long)written, retries, caught, torn, backwards, versions);
+    return report("Seqlock, interrupt writing", ok, detail);
+}
+
+//DoubleBuffer, interrupt reading
+static DoubleBuffer<Item> shared;
+static unsigned long bufferReads, bufferTorn, bufferBackwards;
+static uint32_t bufferLast;
+
+static void readerInterrupt()
+{
+    const Item &item = shared.read();
+    bufferReads++;
+    bufferTorn += item.torn();
+    bufferBackwards += item.serial() < bufferLast;
+    bufferLast = item.serial();
+}
+
+static bool doubleBuffer(const Options &o)
+{
+    bufferReads = bufferTorn = bufferBackwards = bufferLast = 0;
+    handler = readerInterrupt;
+    for (unsigned long round = 0; round < o.rounds; round++)
+    {
+        phase(round);
+        Item item;
+        item.set(round + 1);
+        if (round & 1)
+        {
+            shared.back() = item;
+            shared.publish();
+        }
+        else
+        {
+            shared.write(item);
+        }
+        preemption();
+    }
+    handler = NULL;
+    char detail[160];
+    bool ok = bufferTorn == 0 && bufferBackwards == 0 && bufferReads > 0;
+    snprintf(detail, sizeof(detail), "%lu reads of %lu writes, %lu torn, %lu backwards", bufferReads, o.rounds, bufferTorn, bufferBackwards);
+    return report("DoubleBuffer, interrupt reading", ok, detail);
+}
+
+int main(int argc, char **argv)
+{
+    Options o = {200000, 1};
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "%s needs a value\n", arg);
+            return 2;
+        }
+        unsigned long value = strtoul(argv[++i], NULL, 0);
+        if (strcmp(arg, "--rounds") == 0)
+        {
+            o.rounds = value;
+        }
+        else if (strcmp(arg, "--seed") == 0)
+        {
+            o.seed = value;
+        }
+        else
+        {
+            fprintf(stderr, "unknown option %s, see the top of tools/sim/handoff.cpp\n", arg);
+            return 2;
+        }
+    }
+    state = o.seed ? o.seed : 1;
+
+    bool ok = ringFromInterrupt(o);
+    ok = ringToInterrupt(o) && ok;
+    ok = seqlock(o) && ok;
+    ok = doubleBuffer(o) && ok;
+    return ok ? 0 : 1;
+}
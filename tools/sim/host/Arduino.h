@@ -0,0 +1,89 @@
+/*
+ * Arduino.h - Host stand-in for the Arduino core, for the PS2 emulator and SerialDrive
+ * Part of ONI - Objeto Não Identificado
+ *
+ * Just enough of the core to build PS2X_lib on the host. Time is virtual:
+ * it only moves through delay(), delayMicroseconds(), hostAdvance() and a
+ * fixed cost per port register access, so a bus transaction takes the
+ * same virtual time on every run.
+ *
+ * Port registers are HostPort objects, swapped in through PS2X_PORT. Pin n
+ * is bit n % 8 of port n / 8. Every write that changes an output pin is
+ * passed to the write hook and every input read asks the read hook for
+ * each pin, so a device model sees the bus exactly as the library drives
+ * it. Pins nobody answers for read high, as with the DAT pull-up.
+ *
+ * Interrupt handlers are plain functions: ISR(USART1_RX_vect) defines
+ * USART1_RX_vect(), for the caller to run once it has set the registers.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define HOST_PORTS 16 //pins 0~127
+#define HOST_PORT_ACCESS_NS 500 //virtual time per port register access, about what a masked read-modify-write costs on the AVR
+
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define constrain(x, low, high) ((x) < (low) ? (low) : ((x) > (high) ? (high) : (x)))
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+class HostPort
+{
+  public:
+    HostPort();
+    void attach(uint8_t, bool);
+    HostPort &operator|=(uint8_t mask) { write(value | mask); return *this; }
+    HostPort &operator&=(uint8_t mask) { write(value & mask); return *this; }
+    uint8_t operator&(uint8_t mask) { return read() & mask; }
+    void write(uint8_t);
+    uint8_t read();
+    uint8_t level() const { return value; } //output latch, without the access cost
+  private:
+    uint8_t value;
+    uint8_t index;
+    bool input;
+};
+
+#define PS2X_PORT HostPort
+
+extern uint8_t SREG;
+inline void cli() {}
+inline void sei() {}
+#define ISR(vector) void vector()
+void USART1_RX_vect();
+
+void pinMode(uint8_t, uint8_t);
+void digitalWrite(uint8_t, uint8_t);
+uint8_t digitalPinToBitMask(uint8_t);
+uint8_t digitalPinToPort(uint8_t);
+HostPort *portOutputRegister(uint8_t);
+HostPort *portInputRegister(uint8_t);
+void delay(unsigned long);
+void delayMicroseconds(unsigned int);
+unsigned long millis();
+unsigned long micros();
+long map(long, long, long, long, long);
+
+//Virtual time and the bus hooks
+typedef void (*HostPinWrite)(uint8_t pin, bool level);
+typedef bool (*HostPinRead)(uint8_t pin);
+uint64_t hostNanos();
+void hostAdvance(uint64_t);
+void hostAttach(HostPinWrite, HostPinRead);
+bool hostPin(uint8_t);
+
+#endif
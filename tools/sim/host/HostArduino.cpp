@@ -0,0 +1,151 @@
+/*
+ * HostArduino.cpp - Host stand-in for the Arduino core, for the PS2 emulator and SerialDrive
+ * Part of ONI - Objeto Não Identificado
+ */
+
+#include "Arduino.h"
+
+uint8_t SREG;
+uint8_t UCSR1A, UCSR1B, UCSR1C, UDR1;
+uint16_t UBRR1;
+
+static uint64_t nanos; //virtual time
+static HostPort outputs[HOST_PORTS];
+static HostPort inputs[HOST_PORTS];
+static HostPinWrite onWrite;
+static HostPinRead onRead;
+
+HostPort::HostPort()
+{
+    value = 0;
+    index = 0;
+    input = false;
+}
+
+void HostPort::attach(uint8_t _index, bool _input)
+{
+    index = _index;
+    input = _input;
+}
+
+//Output side. Reports every pin that changed
+void HostPort::write(uint8_t _value)
+{
+    nanos += HOST_PORT_ACCESS_NS;
+    uint8_t changed = value ^ _value;
+    value = _value;
+    for (uint8_t bit = 0; bit < 8; bit++)
+    {
+        if ((changed & (1 << bit)) && onWrite)
+        {
+            onWrite(index * 8 + bit, (value >> bit) & 1);
+        }
+    }
+}
+
+//Input side. Asks for every pin, high when nothing drives it
+uint8_t HostPort::read()
+{
+    nanos += HOST_PORT_ACCESS_NS;
+    if (!input)
+    {
+        return value;
+    }
+    uint8_t levels = 0;
+    for (uint8_t bit = 0; bit < 8; bit++)
+    {
+        if (!onRead || onRead(index * 8 + bit))
+        {
+            levels |= 1 << bit;
+        }
+    }
+    return levels;
+}
+
+void pinMode(uint8_t, uint8_t)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t level)
+{
+    HostPort *port = portOutputRegister(digitalPinToPort(pin));
+    if (level)
+    {
+        *port |= digitalPinToBitMask(pin);
+    }
+    else
+    {
+        *port &= ~digitalPinToBitMask(pin);
+    }
+}
+
+uint8_t digitalPinToBitMask(uint8_t pin)
+{
+    return 1 << (pin % 8);
+}
+
+uint8_t digitalPinToPort(uint8_t pin)
+{
+    return (pin / 8) % HOST_PORTS;
+}
+
+HostPort *portOutputRegister(uint8_t port)
+{
+    outputs[port].attach(port, false);
+    return &outputs[port];
+}
+
+HostPort *portInputRegister(uint8_t port)
+{
+    inputs[port].attach(port, true);
+    return &inputs[port];
+}
+
+void delay(unsigned long ms)
+{
+    nanos += ms * 1000000ULL;
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    nanos += us * 1000ULL;
+}
+
+unsigned long millis()
+{
+    return nanos / 1000000;
+}
+
+unsigned long micros()
+{
+    return nanos / 1000;
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max)
+{
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+uint64_t hostNanos()
+{
+    return nanos;
+}
+
+//Lets virtual time pass, as the rest of the firmware would between bus transactions
+void hostAdvance(uint64_t ns)
+{
+    nanos += ns;
+}
+
+//Connects a device model. Either hook may be NULL
+void hostAttach(HostPinWrite write, HostPinRead read)
+{
+    onWrite = write;
+    onRead = read;
+}
+
+//Output level of a pin, as last written
+bool hostPin(uint8_t pin)
+{
+    return outputs[digitalPinToPort(pin)].level() & digitalPinToBitMask(pin);
+}
@@ -0,0 +1,25 @@
+/*
+ * Timebase.h - Host stand-in for lib/Timebase, on the virtual time of Arduino.h
+ * Part of ONI - Objeto Não Identificado
+ */
+
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include "Arduino.h"
+
+class Timebase
+{
+  public:
+    static void begin() {}
+    static uint32_t ms() { return hostNanos() / 1000000; }
+    static uint32_t now() { return hostNanos() / 1000; }
+    static uint32_t ticks() { return hostNanos() / 500; }
+
+    static uint32_t elapsedMs(uint32_t since) { return ms() - since; }
+    static uint32_t elapsedUs(uint32_t since) { return now() - since; }
+    static bool reachedMs(uint32_t deadline) { return int32_t(ms() - deadline) >= 0; }
+    static bool reachedUs(uint32_t deadline) { return int32_t(now() - deadline) >= 0; }
+};
+
+#endif
@@ -0,0 +1,33 @@
+/*
+ * avr/io.h - Host stand-in for the AVR registers
+ * Part of ONI - Objeto Não Identificado
+ *
+ * The port registers PS2X_lib uses are HostPort objects in Arduino.h.
+ * Here are only the USART1 registers SerialDrive uses, plain bytes the
+ * caller fills before running the receive interrupt, see serialdrive.cpp.
+ */
+
+#ifndef HOST_AVR_IO_H
+#define HOST_AVR_IO_H
+
+#include <stdint.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+extern uint8_t UCSR1A, UCSR1B, UCSR1C, UDR1;
+extern uint16_t UBRR1;
+
+//UCSR1A
+#define FE1 4
+#define DOR1 3
+#define U2X1 1
+//UCSR1B
+#define RXCIE1 7
+#define RXEN1 4
+//UCSR1C
+#define UCSZ11 2
+#define UCSZ10 1
+
+#endif
@@ -0,0 +1,14 @@
+/*
+ * util/atomic.h - Host stand-in for avr-libc's, the host runs interrupts only when told to
+ * Part of ONI - Objeto Não Identificado
+ */
+
+#ifndef HOST_UTIL_ATOMIC_H
+#define HOST_UTIL_ATOMIC_H
+
+#include <stdint.h>
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_BLOCK(type) for (uint8_t atomicOnce_ = 1; atomicOnce_; atomicOnce_ = 0)
+
+#endif
@@ -0,0 +1,22 @@
+/*
+ * util/crc16.h - Host stand-in for avr-libc's, only the CRC-8 SerialDrive uses
+ * Part of ONI - Objeto Não Identificado
+ */
+
+#ifndef HOST_UTIL_CRC16_H
+#define HOST_UTIL_CRC16_H
+
+#include <stdint.h>
+
+//CRC-8, polynomial 0x07, one byte at a time
+static inline uint8_t _crc8_ccitt_update(uint8_t crc, uint8_t data)
+{
+    crc ^= data;
+    for (uint8_t i = 0; i < 8; i++)
+    {
+        crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
+#endif
@@ -0,0 +1,331 @@
+/*
+ * ps2emu.cpp - PS2X_lib against an emulated controller, on the host
+ * Part of ONI - Objeto Não Identificado
+ *
+ * Builds the firmware's own PS2X_lib and PS2XBus against the host core in
+ * host/, whose port registers drive PS2Device models bit by bit. Each
+ * scenario configures a controller with config_gamepad(), polls it every
+ * --period ms of virtual time with changing sticks and buttons, and checks
+ * every frame PS2X accepts against what the controller sent: a frame that
+ * passes validation with the wrong data counts as undetected. Bus time is
+ * the virtual time read_gamepad() takes, retries and delays included, with
+ * HOST_PORT_ACCESS_NS per port access on top of the library's delays.
+ *
+ * Two controllers then share the bus through PS2XBus: the instructor must
+ * take over while holding L1+L2 and hand back on release, and while it is
+ * unplugged, looking for it must fit spareControllerManager()'s budget.
+ * Exits with 1 when either check fails.
+ *
+ *   ps2emu [options]              runs every scenario
+ *   ps2emu [options] --sweep-ack  frame status against the controller ACK delay, as CSV
+ *
+ * Options (defaults in brackets):
+ *   --reads n     polls per scenario [500]
+ *   --period ms   virtual time between polls, the firmware's control cycle [50]
+ *   --seed n      fault generator seed [1]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Arduino.h"
+#include "PS2X_lib.h"
+#include "PS2XBus.h"
+#include "PS2Device.h"
+
+//Same pins as oni.cpp
+#define PS2_DAT 14
+#define PS2_CMD 15
+#define PS2_SEL 16
+#define PS2_CLK 17
+#define PS2_SEL_INSTRUCTOR 30
+#define SPARE_BUDGET 2000 //us, spareControllerManager()'s task budget
+
+struct Options
+{
+    unsigned reads;
+    unsigned period; //ms
+    uint32_t seed;
+};
+
+struct Scenario
+{
+    const char *name;
+    PS2Faults faults;
+    uint8_t type;
+    bool pressures;
+    bool rumble;
+};
+
+struct Result
+{
+    byte error; //config_gamepad()
+    unsigned long detectUs;
+    unsigned long frames[PS2X_FRAME_STATUSES];
+    unsigned long undetected; //accepted frames with the wrong data
+    unsigned long busTotal, busWorst; //us
+};
+
+static const char *STATUS_NAMES[PS2X_FRAME_STATUSES] = {"ok", "noResponse", "badMode", "notAnalog", "badLength", "brownout"};
+
+//Sticks and buttons of poll i. Never every button pressed or every stick on 115, those are brown-out patterns
+static void pattern(unsigned i, uint8_t sticks[4], uint16_t &buttons)
+{
+    sticks[0] = (i * 37 + 11) & 0xFF; //lx
+    sticks[1] = (i * 59 + 3) & 0xFF; //ly
+    sticks[2] = (i * 83 + 200) & 0xFF; //rx
+    sticks[3] = (i * 13 + 90) & 0xFF; //ry
+    buttons = (i * 0x9E37) & 0x7FFF;
+}
+
+//Whether an accepted frame carries what the controller was given
+static bool matches(PS2X &pad, const uint8_t sticks[4], uint16_t buttons, bool pressures)
+{
+    if ((pad.ButtonDataByte() & 0xFFFF) != buttons)
+    {
+        return false;
+    }
+    if (pad.Analog(PSS_LX) != sticks[0] || pad.Analog(PSS_LY) != sticks[1] || pad.Analog(PSS_RX) != sticks[2] || pad.Analog(PSS_RY) != sticks[3])
+    {
+        return false;
+    }
+    return !pressures || pad.Analog(PSAB_CROSS) == ((buttons & PSB_CROSS) ? 0xFF : 0x00);
+}
+
+static Result run(const Scenario &scenario, const Options &o, PS2Device &device, PS2X &pad)
+{
+    Result r;
+    memset(&r, 0, sizeof(r));
+    device.faults = scenario.faults;
+    PS2Wiring::connect(PS2_CLK, PS2_CMD, PS2_DAT);
+    PS2Wiring::attach(device, PS2_SEL);
+    pad.enableBrownoutDetect(true); //as oni.cpp
+
+    uint64_t start = hostNanos();
+    r.error = pad.config_gamepad(PS2_CLK, PS2_CMD, PS2_SEL, PS2_DAT, scenario.pressures, scenario.rumble);
+    r.detectUs = (hostNanos() - start) / 1000;
+
+    for (unsigned i = 0; i < o.reads; i++)
+    {
+        uint8_t sticks[4];
+        uint16_t buttons;
+        pattern(i, sticks, buttons);
+        device.setSticks(sticks[0], sticks[1], sticks[2], sticks[3]);
+        device.setButtons(buttons);
+        hostAdvance(o.period * 1000000ULL);
+
+        start = hostNanos();
+        pad.read_gamepad(scenario.rumble, scenario.rumble ? 200 : 0);
+        unsigned long bus = (hostNanos() - start) / 1000;
+        r.busTotal += bus;
+        if (bus > r.busWorst)
+        {
+            r.busWorst = bus;
+        }
+        r.frames[pad.frameStatus()]++;
+        if (pad.frameStatus() == PS2X_FRAME_OK && !matches(pad, sticks, buttons, scenario.pressures))
+        {
+            r.undetected++;
+        }
+    }
+    PS2Wiring::disconnect();
+    return r;
+}
+
+static void report(const Scenario &scenario, const Options &o, const Result &r, PS2Device &device, PS2X &pad)
+{
+    const PS2X_Stats &link = pad.stats();
+    const PS2DeviceStats &injected = device.stats();
+    printf("%s: detect error %u in %lu us, type %u, mode 0x%02X\n", scenario.name, r.error, r.detectUs, pad.readType(), device.mode());
+    printf(" frames");
+    for (uint8_t s = 0; s < PS2X_FRAME_STATUSES; s++)
+    {
+        printf(" %s %lu", STATUS_NAMES[s], r.frames[s]);
+    }
+    printf(", undetected %lu\n", r.undetected);
+    printf(" retries %u reconfigs %u, bus mean %lu us worst %lu us\n", link.retries, link.reconfigs, o.reads ? r.busTotal / o.reads : 0, r.busWorst);
+    printf(" injected: dropped %lu slowAck %lu brownout %lu sticks115 %lu revert %lu", injected.dropped, injected.slowAck, injected.brownouts, injected.sticks115, injected.reverts);
+    if (scenario.rumble)
+    {
+        printf(", motors %u %u", device.motor(0), device.motor(1));
+    }
+    printf("\n");
+}
+
+//Two controllers sharing the bus, the way oni.cpp reads them: the driver every cycle, the other one in turns.
+//The instructor holds L1+L2 through the middle third to take over, and must get control within a cycle of
+//pressing and give it back within a cycle of releasing. Returns false when it doesn't
+static bool sharedBus(const Options &o)
+{
+    PS2Device student(PS2_DUALSHOCK, o.seed);
+    PS2Device instructor(PS2_WIRELESS, o.seed + 1);
+    PS2X studentPad = PS2X();
+    PS2X instructorPad = PS2X();
+    PS2XBus bus(PS2_CLK, PS2_CMD, PS2_DAT);
+    PS2Wiring::connect(PS2_CLK, PS2_CMD, PS2_DAT);
+    PS2Wiring::attach(student, PS2_SEL);
+    PS2Wiring::attach(instructor, PS2_SEL_INSTRUCTOR);
+    bus.add(studentPad, PS2_SEL, 1, 0);
+    bus.add(instructorPad, PS2_SEL_INSTRUCTOR, 0, PSB_L1 | PSB_L2);
+    bus.begin();
+    byte errors = bus.detect(0) | bus.detect(1);
+    unsigned long good[2] = {0, 0};
+    unsigned press = o.reads / 3, release = 2 * o.reads / 3;
+    unsigned wrong = 0; //cycles with the wrong driver, not counting the one after a press or release
+    uint64_t start = hostNanos();
+    for (unsigned i = 0; i < o.reads; i++)
+    {
+        if (i == press)
+        {
+            instructor.setButtons(PSB_L1 | PSB_L2);
+        }
+        else if (i == release)
+        {
+            instructor.setButtons(0);
+        }
+        hostAdvance(o.period * 1000000ULL);
+        bus.read(bus.driver());
+        int8_t other = bus.next();
+        good[bus.driver()] += bus.pad(bus.driver()).frameStatus() == PS2X_FRAME_OK;
+        if (other >= 0)
+        {
+            good[other] += bus.pad(other).frameStatus() == PS2X_FRAME_OK;
+        }
+        uint8_t expected = i >= press && i < release ? 1 : 0;
+        if (bus.arbitrate() != expected && i != press && i != release)
+        {
+            wrong++;
+        }
+    }
+    unsigned long busUs = (hostNanos() - start) / 1000 - o.reads * o.period * 1000UL;
+    bool ok = errors == 0 && wrong == 0;
+    printf("shared bus: detect errors %u, ok frames %lu %lu, bus %lu us per cycle, instructor L1+L2 at %u released at %u, cycles with the wrong driver %u: %s\n", errors, good[0], good[1], o.reads ? busUs / o.reads : 0, press, release, wrong, ok ? "ok" : "FAIL");
+    PS2Wiring::disconnect();
+    return ok;
+}
+
+//The instructor's controller unplugged for the first half: the spare read that finds it missing must fit its
+//2000 us task budget in spareControllerManager(), so it doesn't hold up the control path. Plugged back in, it
+//must be read again. Returns false when either fails
+static bool missingInstructor(const Options &o)
+{
+    PS2Device student(PS2_DUALSHOCK, o.seed);
+    PS2Device instructor(PS2_WIRELESS, o.seed + 1);
+    instructor.faults.detached = true;
+    PS2X studentPad = PS2X();
+    PS2X instructorPad = PS2X();
+    PS2XBus bus(PS2_CLK, PS2_CMD, PS2_DAT);
+    PS2Wiring::connect(PS2_CLK, PS2_CMD, PS2_DAT);
+    PS2Wiring::attach(student, PS2_SEL);
+    PS2Wiring::attach(instructor, PS2_SEL_INSTRUCTOR);
+    bus.add(studentPad, PS2_SEL, 1, 0);
+    bus.add(instructorPad, PS2_SEL_INSTRUCTOR, 0, PSB_L1 | PSB_L2);
+    bus.begin();
+    byte error = bus.detect(1);
+    bus.detect(0);
+    unsigned long probes = 0, worst = 0;
+    for (unsigned i = 0; i < o.reads; i++)
+    {
+        bool missing = i < o.reads / 2;
+        instructor.faults.detached = missing;
+        hostAdvance(o.period * 1000000ULL);
+        bus.read(bus.driver());
+        uint64_t start = hostNanos();
+        int8_t other = bus.next();
+        unsigned long spare = (hostNanos() - start) / 1000;
+        if (missing && other >= 0)
+        {
+            probes++;
+            worst = spare > worst ? spare : worst;
+        }
+    }
+    bool ok = worst <= SPARE_BUDGET && bus.fresh(1);
+    printf("missing instructor: detect error %u, %lu probes, spare read worst %lu us of %u, %s once plugged back in: %s\n", error, probes, worst, SPARE_BUDGET, bus.fresh(1) ? "read" : "not read", ok ? "ok" : "FAIL");
+    PS2Wiring::disconnect();
+    return ok;
+}
+
+//Returns false when a check fails
+static bool scenarios(const Options &o)
+{
+    const PS2Faults clean = {0, 0, 0, 0, 0, false};
+    Scenario list[] =
+    {
+        {"clean", clean, PS2_DUALSHOCK, false, false},
+        {"wireless", clean, PS2_WIRELESS, false, false},
+        {"pressures+rumble", clean, PS2_DUALSHOCK, true, true},
+        {"dropped bits 5%", {0.05, 0, 0, 0, 0, false}, PS2_DUALSHOCK, false, false},
+        {"slow ack 20 us", {0, 20, 0, 0, 0, false}, PS2_DUALSHOCK, false, false},
+        {"brown-out 5%", {0, 0, 0.05, 0, 0, false}, PS2_DUALSHOCK, false, false},
+        {"sticks at 115 5%", {0, 0, 0, 0.05, 0, false}, PS2_DUALSHOCK, false, false},
+        {"digital revert 2%", {0, 0, 0, 0, 0.02, false}, PS2_DUALSHOCK, false, false},
+        {"detached", {0, 0, 0, 0, 0, true}, PS2_DUALSHOCK, false, false},
+    };
+    for (size_t i = 0; i < sizeof(list) / sizeof(list[0]); i++)
+    {
+        PS2Device device(list[i].type, o.seed);
+        PS2X pad = PS2X();
+        Result r = run(list[i], o, device, pad);
+        report(list[i], o, r, device, pad);
+    }
+    bool ok = sharedBus(o);
+    return missingInstructor(o) && ok;
+}
+
+//How slow an ACK PS2X gets away with: it never waits for ACK, only CTRL_BYTE_DELAY between bytes
+static void sweepAck(const Options &o)
+{
+    printf("ackDelay,ok,noResponse,badMode,notAnalog,badLength,undetected,retries,reconfigs,busMean\n");
+    for (unsigned ack = 0; ack <= 12; ack++)
+    {
+        Scenario scenario = {"ack", {0, ack, 0, 0, 0, false}, PS2_DUALSHOCK, false, false};
+        PS2Device device(PS2_DUALSHOCK, o.seed);
+        PS2X pad = PS2X();
+        Result r = run(scenario, o, device, pad);
+        printf("%u,%lu,%lu,%lu,%lu,%lu,%lu,%u,%u,%lu\n", ack, r.frames[PS2X_FRAME_OK], r.frames[PS2X_FRAME_NO_RESPONSE], r.frames[PS2X_FRAME_BAD_MODE], r.frames[PS2X_FRAME_NOT_ANALOG], r.frames[PS2X_FRAME_BAD_LENGTH], r.undetected, pad.stats().retries, pad.stats().reconfigs, o.reads ? r.busTotal / o.reads : 0);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options o = {500, 50, 1};
+    bool sweep = false;
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--sweep-ack") == 0)
+        {
+            sweep = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "%s needs a value\n", arg);
+            return 1;
+        }
+        unsigned long value = strtoul(argv[++i], NULL, 0);
+        if (strcmp(arg, "--reads") == 0)
+        {
+            o.reads = value;
+        }
+        else if (strcmp(arg, "--period") == 0)
+        {
+            o.period = value;
+        }
+        else if (strcmp(arg, "--seed") == 0)
+        {
+            o.seed = value;
+        }
+        else
+        {
+            fprintf(stderr, "unknown option %s, see the top of tools/sim/ps2emu.cpp\n", arg);
+            return 1;
+        }
+    }
+    if (sweep)
+    {
+        sweepAck(o);
+        return 0;
+    }
+    return scenarios(o) ? 0 : 1;
+}
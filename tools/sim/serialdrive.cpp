@@ -0,0 +1,158 @@
+/*
+ * serialdrive.cpp - SerialDrive's receive interrupt and read(), on the host
+ * Part of ONI - Objeto Não Identificado
+ *
+ * Builds the firmware's own SerialDrive against the host core in host/,
+ * where USART1 is a few plain registers. Each byte is put in UDR1, with
+ * its error flags in UCSR1A, and USART1_RX_vect() runs as the interrupt
+ * would, 40 us of virtual time apart as at 250000 baud. The steps below
+ * run in order against the one USART1, each checking what read(),
+ * status() and stats() report afterwards, the resync after a bad crc
+ * above all: a frame cut short must not take the next good one with it.
+ *
+ *   serialdrive
+ *
+ * Exits with 1 when any check fails.
+ */
+
+#include <stdio.h>
+#include "Arduino.h"
+#include <util/crc16.h>
+#include "SerialDrive.h"
+#include "Timebase.h"
+
+#define BAUD 250000 //as oni.cpp
+#define BYTE_TIME 40 //us per byte at BAUD, 10 bits
+#define TIMEOUT 100 //ms, SERIAL_DRIVE_TIMEOUT
+
+//Same masks as PS2X_lib.h
+#define PSB_R3 0x0004
+#define PSB_CROSS 0x4000
+
+static SerialDrive link;
+static unsigned failures = 0;
+
+static void check(const char *what, bool ok)
+{
+    printf("%-66s %s\n", what, ok ? "ok" : "FAIL");
+    failures += !ok;
+}
+
+//One byte through the receive interrupt, flags as UCSR1A would have them
+static void receive(uint8_t data, uint8_t flags = 0)
+{
+    hostAdvance(BYTE_TIME * 1000ULL);
+    UCSR1A = flags;
+    UDR1 = data;
+    USART1_RX_vect();
+}
+
+static void receive(const uint8_t *data, uint8_t length)
+{
+    for (uint8_t i = 0; i < length; i++)
+    {
+        receive(data[i]);
+    }
+}
+
+//A whole frame the way tools/drive.py builds it
+static void frame(uint8_t out[SERIAL_DRIVE_FRAME], uint8_t seq, uint8_t lx, uint8_t ly, uint8_t rx, uint8_t ry, uint16_t buttons)
+{
+    out[0] = SERIAL_DRIVE_SYNC;
+    out[1] = seq;
+    out[2] = lx;
+    out[3] = ly;
+    out[4] = rx;
+    out[5] = ry;
+    out[6] = buttons & 0xFF;
+    out[7] = buttons >> 8;
+    uint8_t crc = 0;
+    for (uint8_t i = 1; i < SERIAL_DRIVE_FRAME - 1; i++)
+    {
+        crc = _crc8_ccitt_update(crc, out[i]);
+    }
+    out[SERIAL_DRIVE_FRAME - 1] = crc;
+}
+
+static void send(uint8_t seq, uint8_t lx = 128, uint8_t ly = 128, uint8_t rx = 128, uint8_t ry = 128, uint16_t buttons = 0)
+{
+    uint8_t bytes[SERIAL_DRIVE_FRAME];
+    frame(bytes, seq, lx, ly, rx, ry, buttons);
+    receive(bytes, SERIAL_DRIVE_FRAME);
+}
+
+static bool holds(uint8_t lx, uint8_t ly, uint8_t rx, uint8_t ry, uint16_t buttons)
+{
+    return link.analog(INPUT_LX) == lx && link.analog(INPUT_LY) == ly && link.analog(INPUT_RX) == rx && link.analog(INPUT_RY) == ry && link.buttons() == buttons;
+}
+
+int main()
+{
+    uint8_t crc = 0;
+    const char *vector = "123456789";
+    for (const char *c = vector; *c; c++)
+    {
+        crc = _crc8_ccitt_update(crc, *c);
+    }
+    check("host CRC-8 of \"123456789\" is 0xF4", crc == 0xF4);
+
+    link.setTimeout(TIMEOUT);
+    link.begin(BAUD);
+    check("begin(250000): UBRR1 7 at double speed, receiver and its interrupt on", UBRR1 == 7 && (UCSR1A & (1 << U2X1)) && UCSR1B == ((1 << RXEN1) | (1 << RXCIE1)));
+    check("nothing received: LOST, sticks centred", !link.read() && link.status() == INPUT_LOST && holds(128, 128, 128, 128, 0));
+
+    send(10, 0, 64, 192, 255, PSB_R3);
+    uint32_t lastByte = Timebase::now();
+    check("clean frame: taken, OK, sticks and buttons as sent", link.read() && link.status() == INPUT_OK && holds(0, 64, 192, 255, PSB_R3));
+    check("arrival() is the time of its last byte", link.arrival() == lastByte);
+    check("R3 pressed since the last read()", (link.buttons() & PSB_R3) && !(link.lastButtons() & PSB_R3));
+    check("no new frame: not taken, still OK, R3 still held", !link.read() && link.status() == INPUT_OK && (link.lastButtons() & PSB_R3));
+
+    //Noise without a sync, then a frame cut short with a false sync in it, right before a good frame:
+    //the bad crc must restart at the false sync, then at the real one, and keep the good frame
+    const uint8_t noise[] = {0x00, 0x5A, 0xFF};
+    const uint8_t cut[] = {SERIAL_DRIVE_SYNC, 11, 0x40, SERIAL_DRIVE_SYNC, 0x41};
+    receive(noise, sizeof(noise));
+    receive(cut, sizeof(cut));
+    send(11, 1, 2, 3, SERIAL_DRIVE_SYNC, PSB_CROSS);
+    SerialDriveStats stats = link.stats();
+    check("cut frame then good frame: the good one is kept", link.read() && holds(1, 2, 3, SERIAL_DRIVE_SYNC, PSB_CROSS));
+    check("two bad crcs counted, two good frames", stats.badChecksum == 2 && stats.frames == 2 && stats.dropped == 0);
+
+    send(12, 5, 5, 5, 5, 0);
+    send(13, 6, 6, 6, 6, 0);
+    check("two frames between reads: the newest is taken, none dropped", link.read() && holds(6, 6, 6, 6, 0) && link.stats().dropped == 0);
+
+    send(16, 7, 7, 7, 7, 0);
+    check("seq 13 then 16: two dropped", link.read() && link.stats().dropped == 2);
+
+    uint8_t bad[SERIAL_DRIVE_FRAME];
+    frame(bad, 17, 9, 9, 9, 9, 0);
+    bad[SERIAL_DRIVE_FRAME - 1] ^= 0x01;
+    receive(bad, SERIAL_DRIVE_FRAME);
+    check("bad crc while the last command is fresh: still OK, not taken", !link.read() && link.status() == INPUT_OK && holds(7, 7, 7, 7, 0) && link.stats().badChecksum == 3);
+
+    uint8_t broken[SERIAL_DRIVE_FRAME];
+    frame(broken, 17, 8, 8, 8, 8, 0);
+    receive(broken, 4);
+    receive(broken[4], 1 << FE1);
+    receive(broken + 5, SERIAL_DRIVE_FRAME - 5);
+    send(18, 3, 3, 3, 3, 0);
+    stats = link.stats();
+    check("framing error mid frame: dropped, the next frame taken", link.read() && holds(3, 3, 3, 3, 0) && stats.serialErrors == 1 && stats.badChecksum == 3);
+
+    hostAdvance((TIMEOUT + 1) * 1000000ULL);
+    check("silent past the timeout: LOST, one timeout", !link.read() && link.status() == INPUT_LOST && link.stats().timeouts == 1 && link.invalidStreak() == 1);
+    receive(bad, SERIAL_DRIVE_FRAME);
+    check("only bad frames coming: BAD", !link.read() && link.status() == INPUT_BAD && link.invalidStreak() == 2);
+    send(19, 4, 4, 4, 4, 0);
+    check("good frame again: OK, streak cleared", link.read() && link.status() == INPUT_OK && link.invalidStreak() == 0);
+
+    link.resetStats();
+    stats = link.stats();
+    check("resetStats(): every counter back to 0", stats.frames == 0 && stats.badChecksum == 0 && stats.serialErrors == 0 && stats.dropped == 0 && stats.timeouts == 0);
+    send(20, 4, 4, 4, 4, 0);
+    check("after resetStats(): frames count again, seq 19 to 20 drops none", link.read() && link.stats().frames == 1 && link.stats().dropped == 0);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,397 @@
+/*
+ * sim.cpp - Host simulator of the drive path
+ * Part of ONI - Objeto Não Identificado
+ *
+ * Runs the firmware's own mixing (DriveMixer) and engine curves
+ * (MotorCurve) on the firmware's cycle timing, and drives a DriveModel
+ * with the PWMs they produce. Time is simulated in 1 ms steps. The control
+ * path marks the firmware's LatencyProbe events in virtual time, from the
+ * poll, mix and output costs given, and each run ends with the same
+ * latency report as the console's "latency" command.
+ *
+ *   sim [options] script...   runs each script, prints its step responses
+ *   sim [options] --sweep     prints turning radius vs stick
+ *
+ * A script has one "time_ms lx ry" line per stick change, held until the
+ * next line; the last line ends the run and '#' starts a comment. A flight
+ * recorder dump (the "R ..." lines of the dump command) is a script too:
+ * the recorded speedL/speedR are replayed, or with --remix the recorded
+ * sticks go through the mixer again.
+ *
+ * Options (defaults in brackets):
+ *   --tau s          motor time constant [0.12]
+ *   --deadband pwm   PWM that barely moves a wheel [60]
+ *   --stall pwm      stall PWM of the engine curves [same as deadband]
+ *   --latency ms     from PWM written to motor responding [5]
+ *   --wheelbase m    distance between the wheels [0.15]
+ *   --top-speed m/s  wheel speed at full PWM [0.8]
+ *   --clock ms       control cycle, how often sticks are mixed [50]
+ *   --frame ms       trajectory row interval, the firmware's output cycle [10]
+ *   --poll-us us     controller read time, PS2X frame plus retries [1100]
+ *   --mix-us us      mode logic and mixing time [700]
+ *   --output-us us   engine curves and L293D::set() time [150]
+ *   --turn rate      turnRate (0~1) [0.4]
+ *   --trajectory dir writes dir/<script name>.csv, one row per frame
+ *   --remix          mix recorded sticks instead of replaying speeds
+ *   --sweep          turning radius table instead of scripts
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "DriveMixer.h"
+#include "MotorCurve.h"
+#include "LatencyProbe.h"
+#include "DriveModel.h"
+
+#define INVERT_LEFT_STICK false //as in oni.cpp
+#define INVERT_RIGHT_STICK true
+#define DRIVE 2 //oni.cpp mode, recorded speeds only count in it
+#define SWEEP_TIME 4000 //ms each sweep point is held, long enough to settle
+#define STEP_SPEED 0.02 //m/s, smaller changes aren't reported as steps
+#define STEP_YAW 0.1 //rad/s
+
+struct Line
+{
+    unsigned long time; //ms from the start
+    int lx, ry;
+    bool recorded; //speeds come from a flight recorder dump
+    int speedL, speedR;
+};
+
+struct Options
+{
+    DriveParameters drive;
+    int stall;
+    unsigned clock;
+    unsigned frame;
+    unsigned pollUs;
+    unsigned mixUs;
+    unsigned outputUs;
+    float turn;
+    const char *trajectory;
+    bool remix;
+    bool sweep;
+};
+
+//Speeds the firmware would run with for a script line
+static void speeds(const Options &o, const Line &line, int &speedL, int &speedR)
+{
+    if (line.recorded && !o.remix)
+    {
+        speedL = line.speedL;
+        speedR = line.speedR;
+        return;
+    }
+    int curve = DriveMixer::stick(line.lx, INVERT_LEFT_STICK);
+    int accel = DriveMixer::stick(line.ry, INVERT_RIGHT_STICK);
+    DriveMixer::mix(accel, curve, o.turn, speedL, speedR);
+}
+
+//Reads a script or a flight recorder dump. Returns false when nothing could be read
+static bool load(const char *path, std::vector<Line> &lines)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror(path);
+        return false;
+    }
+    char text[160];
+    unsigned long time = 0;
+    long lastStamp = -1;
+    while (fgets(text, sizeof(text), file))
+    {
+        Line line = Line();
+        unsigned index, stamp, buttons, mode, frameTime, flags;
+        if (sscanf(text, "R %u %u %d %d %x %u %*d %*d %d %d %u %x", &index, &stamp, &line.lx, &line.ry, &buttons, &mode, &line.speedL, &line.speedR, &frameTime, &flags) == 10)
+        {
+            if (lastStamp >= 0)
+            {
+                time += (stamp - lastStamp) & 0xFFFF; //recorder times are the low 16 bits of Timebase::ms()
+            }
+            lastStamp = stamp;
+            line.time = time;
+            line.recorded = true;
+            if (mode != DRIVE)
+            {
+                line.speedL = line.speedR = 0;
+            }
+        }
+        else if (text[0] == '#' || sscanf(text, "%lu %d %d", &line.time, &line.lx, &line.ry) != 3)
+        {
+            continue;
+        }
+        lines.push_back(line);
+    }
+    fclose(file);
+    if (lines.empty())
+    {
+        fprintf(stderr, "%s: no script lines\n", path);
+        return false;
+    }
+    return true;
+}
+
+//First time after start the signal covered a fraction of the way from its value at start to its value at end
+static long crossing(const std::vector<double> &signal, unsigned long start, unsigned long end, double fraction)
+{
+    double from = signal[start];
+    double change = signal[end] - from;
+    for (unsigned long t = start; t <= end; t++)
+    {
+        if ((signal[t] - from) / change >= fraction)
+        {
+            return t - start;
+        }
+    }
+    return -1;
+}
+
+//First time after start the PWMs differ from what they were at start
+static long reaction(const std::vector<int> &pwmL, const std::vector<int> &pwmR, unsigned long start, unsigned long end)
+{
+    for (unsigned long t = start; t <= end; t++)
+    {
+        if (pwmL[t] != pwmL[start] || pwmR[t] != pwmR[start])
+        {
+            return t - start;
+        }
+    }
+    return -1;
+}
+
+static void reportStep(const char *name, const std::vector<double> &signal, unsigned long start, unsigned long end, double minimum)
+{
+    double change = signal[end] - signal[start];
+    if (fabs(change) < minimum)
+    {
+        return;
+    }
+    printf("  %s %+.3f -> %+.3f: delay %ld ms, rise %ld ms\n", name, signal[start], signal[end], crossing(signal, start, end, 0.1), crossing(signal, start, end, 0.9));
+}
+
+//Runs a script, prints its step responses and optionally writes its trajectory
+static bool run(const Options &o, const char *path)
+{
+    std::vector<Line> lines;
+    if (!load(path, lines))
+    {
+        return false;
+    }
+    FILE *trajectory = NULL;
+    if (o.trajectory != NULL)
+    {
+        std::string name = path;
+        name = name.substr(name.find_last_of('/') + 1);
+        name = std::string(o.trajectory) + "/" + name.substr(0, name.find_last_of('.')) + ".csv";
+        trajectory = fopen(name.c_str(), "w");
+        if (trajectory == NULL)
+        {
+            perror(name.c_str());
+            return false;
+        }
+        fprintf(trajectory, "time,lx,ry,speedL,speedR,pwmL,pwmR,left,right,x,y,heading\n");
+    }
+
+    MotorCurve curve;
+    curve.setLinear(o.stall, o.stall);
+    DriveModel model(o.drive);
+    unsigned long end = lines.back().time;
+    std::vector<double> speed(end + 1), yaw(end + 1);
+    std::vector<int> pwmLs(end + 1), pwmRs(end + 1);
+    LatencyProbe probe;
+    size_t current = 0;
+    int speedL = 0, speedR = 0, pwmL = 0, pwmR = 0;
+    int committedL = 0, committedR = 0;
+    unsigned long committedAt = 0; //ms the engines see the last commit
+    for (unsigned long t = 0; t <= end; t++)
+    {
+        while (current + 1 < lines.size() && lines[current + 1].time <= t)
+        {
+            current++;
+        }
+        if (t % o.clock == 0) //controllerManager(), mixManager() and outputManager() right after, in the same frame
+        {
+            uint32_t now = t * 1000;
+            probe.mark(LATENCY_POLL_START, now);
+            now += o.pollUs;
+            probe.mark(LATENCY_FRAME_RX, now); //the sticks are sampled here
+            speeds(o, lines[current], speedL, speedR);
+            now += o.mixUs;
+            probe.mark(LATENCY_MIX_DONE, now);
+            committedL = curve.apply(speedL);
+            committedR = curve.apply(speedR);
+            now += o.outputUs;
+            probe.mark(LATENCY_OUTPUT_COMMIT, now);
+            committedAt = (now + 999) / 1000;
+        }
+        if (t >= committedAt)
+        {
+            pwmL = committedL;
+            pwmR = committedR;
+        }
+        model.step(pwmL, pwmR);
+        speed[t] = model.speed();
+        yaw[t] = model.yawRate();
+        pwmLs[t] = pwmL;
+        pwmRs[t] = pwmR;
+        if (trajectory != NULL && t % o.frame == 0)
+        {
+            fprintf(trajectory, "%lu,%d,%d,%d,%d,%d,%d,%.4f,%.4f,%.4f,%.4f,%.4f\n", t, lines[current].lx, lines[current].ry, speedL, speedR, pwmL, pwmR, model.left, model.right, model.x, model.y, model.heading);
+        }
+    }
+    if (trajectory != NULL)
+    {
+        fclose(trajectory);
+    }
+
+    printf("%s: %lu ms, ends at x %.3f m y %.3f m heading %.1f deg\n", path, end, model.x, model.y, model.heading * 180 / M_PI);
+    for (size_t i = 0; i + 1 < lines.size(); i++)
+    {
+        unsigned long start = lines[i].time;
+        unsigned long stop = lines[i + 1].time - 1; //the step settles until the next line
+        if (stop <= start || stop > end)
+        {
+            continue;
+        }
+        if (fabs(speed[stop] - speed[start]) < STEP_SPEED && fabs(yaw[stop] - yaw[start]) < STEP_YAW)
+        {
+            continue; //nothing moved
+        }
+        printf(" step at %lu ms, lx %d ry %d, pwm after %ld ms\n", start, lines[i].lx, lines[i].ry, reaction(pwmLs, pwmRs, start, stop));
+        reportStep("speed m/s", speed, start, stop, STEP_SPEED);
+        reportStep("yaw rad/s", yaw, start, stop, STEP_YAW);
+    }
+    char line[48];
+    for (uint8_t event = LATENCY_FRAME_RX; event < LATENCY_EVENTS; event++)
+    {
+        probe.format(event, line);
+        printf(" %s\n", line);
+    }
+    printf(" latency cycles %u sampling 0~%lu\n", probe.cycles(), o.clock * 1000UL);
+    return true;
+}
+
+//Turning radius at steady state for a grid of sticks
+static void sweep(const Options &o)
+{
+    MotorCurve curve;
+    curve.setLinear(o.stall, o.stall);
+    const int accels[] = {0, 64}; //ry: full and half forward
+    printf("ry,lx,speedL,speedR,speed,yaw,radius\n");
+    for (unsigned a = 0; a < sizeof(accels) / sizeof(accels[0]); a++)
+    {
+        for (int lx = 128; lx <= 256; lx += 16)
+        {
+            Line line = Line();
+            line.lx = lx > 255 ? 255 : lx;
+            line.ry = accels[a];
+            int speedL, speedR;
+            speeds(o, line, speedL, speedR);
+            DriveModel model(o.drive);
+            for (unsigned long t = 0; t < SWEEP_TIME; t++)
+            {
+                model.step(curve.apply(speedL), curve.apply(speedR));
+            }
+            double radius = fabs(model.yawRate()) > 1e-6 ? model.speed() / model.yawRate() : INFINITY;
+            printf("%d,%d,%d,%d,%.3f,%.3f,%.3f\n", line.ry, line.lx, speedL, speedR, model.speed(), model.yawRate(), radius);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Options o;
+    o.drive.tau = 0.12;
+    o.drive.deadband = 60;
+    o.drive.latency = 5;
+    o.drive.wheelBase = 0.15;
+    o.drive.topSpeed = 0.8;
+    o.stall = -1;
+    o.clock = 50;
+    o.frame = 10;
+    o.pollUs = 1100;
+    o.mixUs = 700;
+    o.outputUs = 150;
+    o.turn = 0.4;
+    o.trajectory = NULL;
+    o.remix = false;
+    o.sweep = false;
+
+    std::vector<const char *> scripts;
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        bool valued = true;
+        if (!strcmp(arg, "--remix"))
+        {
+            o.remix = true;
+            valued = false;
+        }
+        else if (!strcmp(arg, "--sweep"))
+        {
+            o.sweep = true;
+            valued = false;
+        }
+        else if (arg[0] != '-')
+        {
+            scripts.push_back(arg);
+            valued = false;
+        }
+        else if (value == NULL)
+        {
+            fprintf(stderr, "%s needs a value\n", arg);
+            return 2;
+        }
+        else if (!strcmp(arg, "--tau")) o.drive.tau = atof(value);
+        else if (!strcmp(arg, "--deadband")) o.drive.deadband = atoi(value);
+        else if (!strcmp(arg, "--stall")) o.stall = atoi(value);
+        else if (!strcmp(arg, "--latency")) o.drive.latency = atoi(value);
+        else if (!strcmp(arg, "--wheelbase")) o.drive.wheelBase = atof(value);
+        else if (!strcmp(arg, "--top-speed")) o.drive.topSpeed = atof(value);
+        else if (!strcmp(arg, "--clock")) o.clock = atoi(value);
+        else if (!strcmp(arg, "--frame")) o.frame = atoi(value);
+        else if (!strcmp(arg, "--poll-us")) o.pollUs = atoi(value);
+        else if (!strcmp(arg, "--mix-us")) o.mixUs = atoi(value);
+        else if (!strcmp(arg, "--output-us")) o.outputUs = atoi(value);
+        else if (!strcmp(arg, "--turn")) o.turn = atof(value);
+        else if (!strcmp(arg, "--trajectory")) o.trajectory = value;
+        else
+        {
+            fprintf(stderr, "unknown option %s, see the top of tools/sim/sim.cpp\n", arg);
+            return 2;
+        }
+        i += valued;
+    }
+    if (o.stall < 0)
+    {
+        o.stall = o.drive.deadband; //perfectly calibrated
+    }
+    if (o.clock == 0 || o.frame == 0)
+    {
+        fprintf(stderr, "--clock and --frame must be above 0\n");
+        return 2;
+    }
+
+    if (o.sweep)
+    {
+        sweep(o);
+        return 0;
+    }
+    if (scripts.empty())
+    {
+        fprintf(stderr, "usage: sim [options] script... | sim [options] --sweep\n");
+        return 2;
+    }
+    bool ok = true;
+    for (size_t i = 0; i < scripts.size(); i++)
+    {
+        ok = run(o, scripts[i]) && ok;
+    }
+    return ok ? 0 : 1;
+}
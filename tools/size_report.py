@@ -0,0 +1,100 @@
+# ONI - Objeto Não Identificado
+# PlatformIO post script: per-symbol flash/RAM report and budget check
+#
+# Runs after the firmware is linked. Prints the largest flash and RAM
+# symbols, writes the full listing to $BUILD_DIR/size_report.txt and fails
+# the build when flash (.text + .data) or static RAM (.data + .bss +
+# .noinit) go past custom_flash_budget / custom_ram_budget in
+# platformio.ini. Whatever RAM is left over is what the stack has.
+
+import subprocess
+
+Import("env")
+
+TOP_SYMBOLS = 15
+
+
+def tool(name):
+    # avr-gcc -> avr-nm / avr-size, from the same toolchain
+    return env.subst("$CC").replace("gcc", name)
+
+
+def budget(option):
+    try:
+        return int(env.GetProjectOption(option))
+    except Exception:
+        return 0
+
+
+def sections(elf):
+    # name -> (size, address), addresses as the linker placed them: RAM sits at 0x800000 and up
+    table = {}
+    out = subprocess.check_output([tool("size"), "-A", "-d", elf]).decode()
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) >= 3 and fields[0].startswith(".") and fields[1].isdigit() and fields[2].isdigit():
+            table[fields[0]] = (int(fields[1]), int(fields[2]))
+    return table
+
+
+def symbols(elf, table):
+    # Sorted by the section holding the symbol's address, not by nm's type letter: weak symbols (W/V) can be
+    # code or data either way. text lives in flash, bss/noinit in RAM, data in both (copied to RAM at boot)
+    places = {".text": (True, False), ".data": (True, True), ".bss": (False, True), ".noinit": (False, True)}
+    ranges = [(table[name][1], table[name][1] + table[name][0], place) for name, place in places.items() if name in table]
+    flash, ram = [], []
+    out = subprocess.check_output([tool("nm"), "--print-size", "--size-sort", "--radix=d", "-C", elf]).decode()
+    for line in out.splitlines():
+        fields = line.split(None, 3)
+        if len(fields) < 4:
+            continue
+        address, size, name = int(fields[0]), int(fields[1]), fields[3]
+        for start, end, (in_flash, in_ram) in ranges:
+            if start <= address < end:
+                if in_flash:
+                    flash.append((size, name))
+                if in_ram:
+                    ram.append((size, name))
+                break
+    flash.sort(reverse=True)
+    ram.sort(reverse=True)
+    return flash, ram
+
+
+def size_report(source, target, env):
+    elf = target[0].get_abspath()
+    table = sections(elf)
+    sizes = dict((name, size) for name, (size, address) in table.items())
+    flash_used = sizes.get(".text", 0) + sizes.get(".data", 0)
+    ram_used = sizes.get(".data", 0) + sizes.get(".bss", 0) + sizes.get(".noinit", 0)
+    flash_budget = budget("custom_flash_budget")
+    ram_budget = budget("custom_ram_budget")
+    flash, ram = symbols(elf, table)
+
+    lines = ["Flash %d / %d bytes, RAM %d / %d bytes" % (flash_used, flash_budget, ram_used, ram_budget)]
+    for title, table in (("Flash", flash), ("RAM", ram)):
+        lines.append("")
+        lines.append("%s by symbol:" % title)
+        lines.extend("%7d  %s" % entry for entry in table)
+
+    with open(env.subst("$BUILD_DIR/size_report.txt"), "w") as report:
+        report.write("\n".join(lines) + "\n")
+
+    print(lines[0])
+    for title, table in (("flash", flash), ("RAM", ram)):
+        print("Largest %s symbols:" % title)
+        for entry in table[:TOP_SYMBOLS]:
+            print("%7d  %s" % entry)
+    print("Full listing in " + env.subst("$BUILD_DIR/size_report.txt"))
+
+    over = []
+    if flash_budget and flash_used > flash_budget:
+        over.append("flash %d > %d" % (flash_used, flash_budget))
+    if ram_budget and ram_used > ram_budget:
+        over.append("RAM %d > %d" % (ram_used, ram_budget))
+    if over:
+        print("Size budget exceeded: " + ", ".join(over))
+        env.Exit(1)
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", size_report)